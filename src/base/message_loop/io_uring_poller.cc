@@ -0,0 +1,399 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/message_loop/io_uring_poller.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/check.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/posix/eintr_wrapper.h"
+
+// The io_uring syscall numbers are shared by all architectures.
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+namespace base {
+
+namespace {
+
+// Size of the submission ring. Queued requests are flushed early if it fills.
+constexpr unsigned kSubmissionEntries = 256;
+// Size of the completion ring. Every watch can complete between two polls, so
+// this is larger. The kernel buffers any excess (IORING_FEAT_NODROP).
+constexpr unsigned kCompletionEntries = 4096;
+
+// Completions that do not belong to a watch. Watches are heap allocated and
+// aligned, so their addresses never collide with these.
+constexpr uint64_t kIgnoredTag = 0;
+constexpr uint64_t kTimeoutTag = 1;
+
+unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* p, unsigned value) {
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+int IOUringSetup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IOUringEnter(int ring_fd,
+                 unsigned to_submit,
+                 unsigned min_complete,
+                 unsigned flags) {
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+}  // namespace
+
+// Mappings of the rings shared with the kernel.
+struct IOUringPoller::Ring {
+  Ring() = default;
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_size);
+    if (ring_ptr != MAP_FAILED)
+      munmap(ring_ptr, ring_size);
+  }
+
+  void* ring_ptr = MAP_FAILED;
+  size_t ring_size = 0;
+  void* sqes = MAP_FAILED;
+  size_t sqes_size = 0;
+
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_mask = nullptr;
+  unsigned* sq_entries = nullptr;
+  unsigned* sq_flags = nullptr;
+  unsigned* sq_array = nullptr;
+
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+
+  // Read by the kernel when an IORING_OP_TIMEOUT request is submitted.
+  __kernel_timespec timeout = {};
+};
+
+// static
+std::unique_ptr<IOUringPoller> IOUringPoller::Create() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = kCompletionEntries;
+  int ring_fd = IOUringSetup(kSubmissionEntries, &params);
+  if (ring_fd < 0) {
+    PLOG(WARNING) << "io_uring_setup";
+    return nullptr;
+  }
+
+  // Single mmap (5.4) and no dropped completions (5.5) keep this simple.
+  constexpr unsigned kRequiredFeatures =
+      IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+  if ((params.features & kRequiredFeatures) != kRequiredFeatures) {
+    LOG(WARNING) << "io_uring lacks required features";
+    if (IGNORE_EINTR(close(ring_fd)) < 0)
+      DPLOG(ERROR) << "close";
+    return nullptr;
+  }
+
+  auto ring = std::make_unique<Ring>();
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  ring->ring_size = std::max(sq_size, cq_size);
+  ring->ring_ptr = mmap(nullptr, ring->ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  if (ring->ring_ptr != MAP_FAILED) {
+    ring->sqes = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  }
+  if (ring->ring_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    PLOG(WARNING) << "mmap io_uring";
+    ring.reset();
+    if (IGNORE_EINTR(close(ring_fd)) < 0)
+      DPLOG(ERROR) << "close";
+    return nullptr;
+  }
+
+  char* base = static_cast<char*>(ring->ring_ptr);
+  ring->sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+  ring->sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+  ring->sq_mask = reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+  ring->sq_entries =
+      reinterpret_cast<unsigned*>(base + params.sq_off.ring_entries);
+  ring->sq_flags = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+  ring->sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+  ring->cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+  ring->cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+  ring->cq_mask = reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+  return WrapUnique(new IOUringPoller(ring_fd, std::move(ring)));
+}
+
+IOUringPoller::IOUringPoller(int ring_fd, std::unique_ptr<Ring> ring)
+    : ring_fd_(ring_fd), ring_(std::move(ring)) {}
+
+IOUringPoller::~IOUringPoller() {
+  while (!watches_.empty()) {
+    Watch* watch = watches_.head()->value();
+    watch->RemoveFromList();
+    delete watch;
+  }
+  // Closing the ring cancels all outstanding requests.
+  if (IGNORE_EINTR(close(ring_fd_)) < 0)
+    DPLOG(ERROR) << "close";
+}
+
+IOUringPoller::Watch* IOUringPoller::Add(int fd,
+                                         bool read,
+                                         bool write,
+                                         bool persistent,
+                                         Callback callback,
+                                         void* context) {
+  DCHECK(read || write);
+  Watch* watch = new Watch;
+  watch->fd = fd;
+  watch->read = read;
+  watch->write = write;
+  watch->persistent = persistent;
+  watch->callback = callback;
+  watch->context = context;
+  watches_.Append(watch);
+
+  // Armed in the next Poll(), together with the wait.
+  watch->queued = true;
+  pending_arms_.push_back(watch);
+  return watch;
+}
+
+void IOUringPoller::Remove(Watch* watch) {
+  DCHECK(!watch->removed);
+  watch->removed = true;
+  if (watch->in_flight)
+    PushPollRemove(watch);
+  MaybeDelete(watch);
+}
+
+void IOUringPoller::Poll(bool block, TimeDelta timeout) {
+  ArmPendingWatches();
+
+  if (block && completions_.empty() && !HasCompletions()) {
+    if (!timeout.is_max()) {
+      // A timeout left over from an interrupted wait would wake us early.
+      if (timeouts_in_flight_ > 0) {
+        io_uring_sqe* sqe = GetSubmissionEntry();
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = kTimeoutTag;
+        sqe->user_data = kIgnoredTag;
+      }
+      PushTimeout(std::max(timeout, TimeDelta()));
+    }
+    Enter(/*wait_nr=*/1);
+  } else if (to_submit_ > 0 ||
+             (__atomic_load_n(ring_->sq_flags, __ATOMIC_RELAXED) &
+              IORING_SQ_CQ_OVERFLOW)) {
+    Enter(/*wait_nr=*/0);
+  }
+
+  ReapCompletions();
+  DispatchCompletions();
+}
+
+io_uring_sqe* IOUringPoller::GetSubmissionEntry() {
+  unsigned tail = *ring_->sq_tail;
+  if (tail - LoadAcquire(ring_->sq_head) >= *ring_->sq_entries) {
+    // The submission ring is full. Hand the queued entries to the kernel.
+    bool submitted = Enter(/*wait_nr=*/0);
+    CHECK(submitted && tail - LoadAcquire(ring_->sq_head) < *ring_->sq_entries)
+        << "io_uring submission ring is stuck";
+  }
+
+  unsigned index = tail & *ring_->sq_mask;
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(ring_->sqes) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  ring_->sq_array[index] = index;
+  // Without SQPOLL the kernel only reads the ring inside io_uring_enter() on
+  // this thread, so the caller can still fill in |sqe| after this.
+  StoreRelease(ring_->sq_tail, tail + 1);
+  to_submit_++;
+  return sqe;
+}
+
+void IOUringPoller::PushPollAdd(Watch* watch) {
+  io_uring_sqe* sqe = GetSubmissionEntry();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = watch->fd;
+  sqe->poll_events = (watch->read ? POLLIN : 0) | (watch->write ? POLLOUT : 0);
+  sqe->user_data = reinterpret_cast<uintptr_t>(watch);
+  watch->in_flight = true;
+}
+
+void IOUringPoller::PushPollRemove(Watch* watch) {
+  io_uring_sqe* sqe = GetSubmissionEntry();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uintptr_t>(watch);
+  sqe->user_data = kIgnoredTag;
+}
+
+void IOUringPoller::PushTimeout(TimeDelta timeout) {
+  int64_t seconds = timeout.InSeconds();
+  ring_->timeout.tv_sec = seconds;
+  ring_->timeout.tv_nsec = (timeout - Seconds(seconds)).InNanoseconds();
+
+  io_uring_sqe* sqe = GetSubmissionEntry();
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uintptr_t>(&ring_->timeout);
+  sqe->len = 1;
+  // Also completes as soon as any other request completes, so the timeout
+  // normally does not outlive the wait it was armed for.
+  sqe->off = 1;
+  sqe->user_data = kTimeoutTag;
+  timeouts_in_flight_++;
+}
+
+bool IOUringPoller::Enter(unsigned wait_nr) {
+  bool reaped = false;
+  for (;;) {
+    unsigned flags = 0;
+    if (wait_nr > 0 || (__atomic_load_n(ring_->sq_flags, __ATOMIC_RELAXED) &
+                        IORING_SQ_CQ_OVERFLOW)) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+    int rv = IOUringEnter(ring_fd_, to_submit_, wait_nr, flags);
+    if (rv >= 0) {
+      to_submit_ -= std::min(static_cast<unsigned>(rv), to_submit_);
+      return true;
+    }
+    if ((errno == EBUSY || errno == EAGAIN) && !reaped) {
+      // Completions are backed up in the kernel. Make room and retry once.
+      ReapCompletions();
+      reaped = true;
+      continue;
+    }
+    if (errno != EINTR)
+      DPLOG(ERROR) << "io_uring_enter";
+    return false;
+  }
+}
+
+bool IOUringPoller::HasCompletions() const {
+  return LoadAcquire(ring_->cq_tail) != *ring_->cq_head;
+}
+
+void IOUringPoller::ReapCompletions() {
+  unsigned head = *ring_->cq_head;
+  unsigned tail = LoadAcquire(ring_->cq_tail);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = ring_->cqes[head & *ring_->cq_mask];
+    completions_.push_back({cqe.user_data, cqe.res});
+  }
+  StoreRelease(ring_->cq_head, head);
+}
+
+void IOUringPoller::DispatchCompletions() {
+  // Callbacks may reenter Poll(), so take one completion at a time.
+  while (!completions_.empty()) {
+    Completion completion = completions_.front();
+    completions_.pop_front();
+    HandleCompletion(completion);
+  }
+}
+
+void IOUringPoller::HandleCompletion(const Completion& completion) {
+  if (completion.user_data == kIgnoredTag)
+    return;
+  if (completion.user_data == kTimeoutTag) {
+    timeouts_in_flight_--;
+    return;
+  }
+
+  Watch* watch = reinterpret_cast<Watch*>(completion.user_data);
+  DCHECK(watch->in_flight);
+  watch->in_flight = false;
+  if (watch->removed) {
+    MaybeDelete(watch);
+    return;
+  }
+
+  bool can_read;
+  bool can_write;
+  if (completion.res == -ECANCELED) {
+    can_read = false;
+    can_write = false;
+  } else if (completion.res < 0) {
+    // E.g. -EBADF once the fd is closed under a persistent watch. Re-arming
+    // would fail the same way at once, so like epoll the fd is dropped. The
+    // owner finds out about the error from its next read or write.
+    DLOG(ERROR) << "io_uring poll on fd " << watch->fd
+                << " failed: " << -completion.res;
+    can_read = watch->read;
+    can_write = watch->write;
+  } else {
+    // Same as libevent: errors and hangups wake up both directions.
+    int revents = completion.res;
+    bool error = revents & (POLLERR | POLLHUP);
+    can_read = watch->read && (error || (revents & POLLIN));
+    can_write = watch->write && (error || (revents & POLLOUT));
+  }
+
+  // Re-arming is deferred to the next Poll() so that watchers which stop
+  // watching from the callback, the common case, cost nothing.
+  bool hard_error = completion.res < 0 && completion.res != -ECANCELED;
+  if (!hard_error && (watch->persistent || (!can_read && !can_write))) {
+    watch->queued = true;
+    pending_arms_.push_back(watch);
+  }
+  if (can_read || can_write)
+    watch->callback(watch->fd, can_read, can_write, watch->context);
+}
+
+void IOUringPoller::ArmPendingWatches() {
+  for (Watch* watch : pending_arms_) {
+    watch->queued = false;
+    if (watch->removed) {
+      MaybeDelete(watch);
+      continue;
+    }
+    PushPollAdd(watch);
+  }
+  pending_arms_.clear();
+}
+
+void IOUringPoller::MaybeDelete(Watch* watch) {
+  if (!watch->removed || watch->in_flight || watch->queued)
+    return;
+  watch->RemoveFromList();
+  delete watch;
+}
+
+}  // namespace base
@@ -0,0 +1,127 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_MESSAGE_LOOP_IO_URING_POLLER_H_
+#define BASE_MESSAGE_LOOP_IO_URING_POLLER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/containers/circular_deque.h"
+#include "base/containers/linked_list.h"
+#include "base/time/time.h"
+
+struct io_uring_sqe;
+
+namespace base {
+
+// Readiness notifications backed by io_uring, used by MessagePumpLibevent in
+// place of libevent when the MessagePumpIOUring feature is enabled.
+//
+// Watches are submitted as IORING_OP_POLL_ADD requests. Interest changes are
+// queued in the submission ring and handed to the kernel together with the
+// next wait in a single io_uring_enter(), and completions are reaped from the
+// shared completion ring without a syscall. Compared to epoll this removes the
+// epoll_ctl() calls that bracket every would-block read or write, and the
+// epoll_wait() of each non-blocking poll.
+class BASE_EXPORT IOUringPoller {
+ public:
+  using Callback = void (*)(int fd, bool can_read, bool can_write,
+                            void* context);
+
+  struct Watch : public LinkNode<Watch> {
+    int fd;
+    bool read;
+    bool write;
+    bool persistent;
+    Callback callback;
+    void* context;
+
+    // Set by Remove(). The watch is freed once the kernel no longer
+    // references it.
+    bool removed = false;
+    // A POLL_ADD request for this watch has been queued but its completion
+    // has not been reaped yet.
+    bool in_flight = false;
+    // Waiting in |pending_arms_| for a POLL_ADD request.
+    bool queued = false;
+  };
+
+  // Returns null if io_uring is unavailable, e.g. on kernels older than 5.5
+  // or where it is blocked by seccomp.
+  static std::unique_ptr<IOUringPoller> Create();
+
+  IOUringPoller(const IOUringPoller&) = delete;
+  IOUringPoller& operator=(const IOUringPoller&) = delete;
+
+  ~IOUringPoller();
+
+  // Starts watching |fd|. Non-persistent watches fire at most once. If
+  // polling |fd| fails, e.g. because it was closed, the watch fires once for
+  // all watched directions and then stays idle until removed.
+  Watch* Add(int fd,
+             bool read,
+             bool write,
+             bool persistent,
+             Callback callback,
+             void* context);
+
+  // Stops watching. |watch| must not be used afterwards.
+  void Remove(Watch* watch);
+
+  // Submits queued requests and dispatches completions. If |block| is true
+  // and nothing is ready, waits up to |timeout| for a completion, or
+  // indefinitely if |timeout| is TimeDelta::Max(). Reentrant.
+  void Poll(bool block, TimeDelta timeout);
+
+ private:
+  struct Ring;
+
+  struct Completion {
+    uint64_t user_data;
+    int32_t res;
+  };
+
+  IOUringPoller(int ring_fd, std::unique_ptr<Ring> ring);
+
+  // Returns a zeroed submission entry, flushing the ring first if it is full.
+  io_uring_sqe* GetSubmissionEntry();
+  void PushPollAdd(Watch* watch);
+  void PushPollRemove(Watch* watch);
+  void PushTimeout(TimeDelta timeout);
+
+  // Calls io_uring_enter() to submit queued entries, waiting for |wait_nr|
+  // completions. Returns false on error.
+  bool Enter(unsigned wait_nr);
+
+  bool HasCompletions() const;
+  // Moves completions from the shared ring into |completions_|.
+  void ReapCompletions();
+  void DispatchCompletions();
+  void HandleCompletion(const Completion& completion);
+
+  void ArmPendingWatches();
+  void MaybeDelete(Watch* watch);
+
+  const int ring_fd_;
+  const std::unique_ptr<Ring> ring_;
+
+  // Number of entries pushed to the submission ring but not yet submitted.
+  unsigned to_submit_ = 0;
+
+  // Number of IORING_OP_TIMEOUT requests whose completion is not reaped yet.
+  int timeouts_in_flight_ = 0;
+
+  // All live watches, freed in the destructor.
+  LinkedList<Watch> watches_;
+  std::vector<Watch*> pending_arms_;
+  circular_deque<Completion> completions_;
+};
+
+}  // namespace base
+
+#endif  // BASE_MESSAGE_LOOP_IO_URING_POLLER_H_
@@ -12,6 +12,7 @@
 
 #include "base/auto_reset.h"
 #include "base/compiler_specific.h"
+#include "base/feature_list.h"
 #include "base/files/file_util.h"
 #include "base/logging.h"
 #include "base/notreached.h"
@@ -31,9 +32,18 @@
 // StopWatchingFileDescriptor().
 // It is moved into and out of lists in struct event_base by
 // the libevent functions event_add() and event_del().
+//
+// With kMessagePumpIOUring the FdWatchController holds an IOUringPoller::Watch
+// instead, which is owned by the poller and released by
+// StopWatchingFileDescriptor().
 
 namespace base {
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+const Feature kMessagePumpIOUring{"MessagePumpIOUring",
+                                  FEATURE_DISABLED_BY_DEFAULT};
+#endif
+
 MessagePumpLibevent::FdWatchController::FdWatchController(
     const Location& from_here)
     : FdWatchControllerInterface(from_here) {}
@@ -42,6 +52,11 @@ MessagePumpLibevent::FdWatchController::~FdWatchController() {
   if (event_) {
     CHECK(StopWatchingFileDescriptor());
   }
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  if (io_uring_watch_) {
+    CHECK(StopWatchingFileDescriptor());
+  }
+#endif
   if (was_destroyed_) {
     DCHECK(!*was_destroyed_);
     *was_destroyed_ = true;
@@ -49,6 +64,16 @@ MessagePumpLibevent::FdWatchController::~FdWatchController() {
 }
 
 bool MessagePumpLibevent::FdWatchController::StopWatchingFileDescriptor() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  if (io_uring_watch_) {
+    pump_->io_uring_poller_->Remove(io_uring_watch_);
+    io_uring_watch_ = nullptr;
+    pump_ = nullptr;
+    watcher_ = nullptr;
+    return true;
+  }
+#endif
+
   std::unique_ptr<event> e = ReleaseEvent();
   if (!e)
     return true;
@@ -97,6 +122,9 @@ MessagePumpLibevent::MessagePumpLibevent() : event_base_(event_base_new()) {
 }
 
 MessagePumpLibevent::~MessagePumpLibevent() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  io_uring_poller_.reset();
+#endif
   DCHECK(wakeup_event_);
   DCHECK(event_base_);
   event_del(wakeup_event_);
@@ -125,6 +153,13 @@ bool MessagePumpLibevent::WatchFileDescriptor(int fd,
   // threadsafe, and your watcher may never be registered.
   DCHECK(watch_file_descriptor_caller_checker_.CalledOnValidThread());
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  if (io_uring_poller_) {
+    return WatchFileDescriptorIOUring(fd, persistent, mode, controller,
+                                      delegate);
+  }
+#endif
+
   int event_mask = persistent ? EV_PERSIST : 0;
   if (mode & WATCH_READ) {
     event_mask |= EV_READ;
@@ -176,6 +211,48 @@ bool MessagePumpLibevent::WatchFileDescriptor(int fd,
   return true;
 }
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+bool MessagePumpLibevent::WatchFileDescriptorIOUring(
+    int fd,
+    bool persistent,
+    int mode,
+    FdWatchController* controller,
+    FdWatcher* delegate) {
+  bool read = mode & WATCH_READ;
+  bool write = mode & WATCH_WRITE;
+
+  IOUringPoller::Watch* watch = controller->io_uring_watch_;
+  if (watch) {
+    // It's illegal to use this function to listen on 2 separate fds with the
+    // same |controller|.
+    if (watch->fd != fd) {
+      NOTREACHED() << "FDs don't match" << watch->fd << "!=" << fd;
+      return false;
+    }
+
+    // Combine old/new interests.
+    read |= watch->read;
+    write |= watch->write;
+    persistent |= watch->persistent;
+
+    // Keep a watch that is still armed, or about to be, for the same events.
+    if (read == watch->read && write == watch->write &&
+        persistent == watch->persistent &&
+        (watch->in_flight || watch->queued)) {
+      controller->set_watcher(delegate);
+      return true;
+    }
+    io_uring_poller_->Remove(watch);
+  }
+
+  controller->io_uring_watch_ = io_uring_poller_->Add(
+      fd, read, write, persistent, OnIOUringNotification, controller);
+  controller->set_watcher(delegate);
+  controller->set_pump(this);
+  return true;
+}
+#endif
+
 // Tell libevent to break out of inner loop.
 static void timer_callback(int fd, short events, void* context) {
   event_base_loopbreak((struct event_base*)context);
@@ -201,7 +278,14 @@ void MessagePumpLibevent::Run(Delegate* delegate) {
     // Process native events if any are ready. Do not block waiting for more.
     {
       auto scoped_do_work_item = delegate->BeginWorkItem();
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+      if (io_uring_poller_)
+        io_uring_poller_->Poll(/*block=*/false, TimeDelta());
+      else
+        event_base_loop(event_base_, EVLOOP_NONBLOCK);
+#else
       event_base_loop(event_base_, EVLOOP_NONBLOCK);
+#endif
     }
 
     bool attempt_more_work = immediate_work_available || processed_io_events_;
@@ -221,10 +305,25 @@ void MessagePumpLibevent::Run(Delegate* delegate) {
     if (attempt_more_work)
       continue;
 
-    bool did_set_timer = false;
-
     // If there is delayed work.
     DCHECK(!next_work_info.delayed_run_time.is_null());
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+    if (io_uring_poller_) {
+      // The timeout is submitted with the wait, no timer event is needed.
+      delegate->BeforeWait();
+      io_uring_poller_->Poll(/*block=*/true,
+                             next_work_info.delayed_run_time.is_max()
+                                 ? TimeDelta::Max()
+                                 : next_work_info.remaining_delay());
+      if (run_state.should_quit)
+        break;
+      continue;
+    }
+#endif
+
+    bool did_set_timer = false;
+
     if (!next_work_info.delayed_run_time.is_max()) {
       const TimeDelta delay = next_work_info.remaining_delay();
 
@@ -294,6 +393,18 @@ bool MessagePumpLibevent::Init() {
 
   if (event_add(wakeup_event_, nullptr))
     return false;
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  if (FeatureList::IsEnabled(kMessagePumpIOUring)) {
+    io_uring_poller_ = IOUringPoller::Create();
+    if (io_uring_poller_) {
+      io_uring_poller_->Add(wakeup_pipe_out_, /*read=*/true, /*write=*/false,
+                            /*persistent=*/true, OnIOUringWakeup, this);
+    } else {
+      LOG(WARNING) << "io_uring is unavailable, falling back to libevent";
+    }
+  }
+#endif
   return true;
 }
 
@@ -349,4 +460,30 @@ void MessagePumpLibevent::OnWakeup(int socket, short flags, void* context) {
   event_base_loopbreak(that->event_base_);
 }
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+// static
+void MessagePumpLibevent::OnIOUringNotification(int fd,
+                                                bool can_read,
+                                                bool can_write,
+                                                void* context) {
+  short flags = (can_read ? EV_READ : 0) | (can_write ? EV_WRITE : 0);
+  OnLibeventNotification(fd, flags, context);
+}
+
+// static
+void MessagePumpLibevent::OnIOUringWakeup(int fd,
+                                          bool can_read,
+                                          bool can_write,
+                                          void* context) {
+  MessagePumpLibevent* that = static_cast<MessagePumpLibevent*>(context);
+  DCHECK_EQ(that->wakeup_pipe_out_, fd);
+
+  // Drain every pending wakeup byte so that one completion covers them all.
+  char buf[64];
+  while (HANDLE_EINTR(read(fd, buf, sizeof(buf))) > 0) {
+  }
+  that->processed_io_events_ = true;
+}
+#endif
+
 }  // namespace base
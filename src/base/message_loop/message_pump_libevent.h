@@ -12,6 +12,11 @@
 #include "base/message_loop/message_pump.h"
 #include "base/message_loop/watchable_io_message_pump_posix.h"
 #include "base/threading/thread_checker.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+#include "base/message_loop/io_uring_poller.h"
+#endif
 
 // Declare structs we need from libevent.h rather than including it
 struct event_base;
@@ -19,6 +24,14 @@ struct event;
 
 namespace base {
 
+struct Feature;
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+// Watches file descriptors with io_uring instead of libevent where the kernel
+// supports it.
+BASE_EXPORT extern const Feature kMessagePumpIOUring;
+#endif
+
 // Class to monitor sockets and issue callbacks when sockets are ready for I/O
 // TODO(dkegel): add support for background file IO somehow
 class BASE_EXPORT MessagePumpLibevent : public MessagePump,
@@ -56,6 +69,10 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
     void OnFileCanWriteWithoutBlocking(int fd, MessagePumpLibevent* pump);
 
     std::unique_ptr<event> event_;
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+    // Used instead of |event_| when the pump runs on io_uring.
+    IOUringPoller::Watch* io_uring_watch_ = nullptr;
+#endif
     MessagePumpLibevent* pump_ = nullptr;
     FdWatcher* watcher_ = nullptr;
     // If this pointer is non-NULL, the pointee is set to true in the
@@ -95,6 +112,24 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
   // ... callback; called by libevent inside Run() when pipe is ready to read
   static void OnWakeup(int socket, short flags, void* context);
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  // io_uring counterparts of OnLibeventNotification() and OnWakeup().
+  static void OnIOUringNotification(int fd,
+                                    bool can_read,
+                                    bool can_write,
+                                    void* context);
+  static void OnIOUringWakeup(int fd,
+                              bool can_read,
+                              bool can_write,
+                              void* context);
+
+  bool WatchFileDescriptorIOUring(int fd,
+                                  bool persistent,
+                                  int mode,
+                                  FdWatchController* controller,
+                                  FdWatcher* delegate);
+#endif
+
   struct RunState {
     explicit RunState(Delegate* delegate_in) : delegate(delegate_in) {}
 
@@ -121,6 +156,12 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
   // ... libevent wrapper for read end
   event* wakeup_event_ = nullptr;
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  // Replaces |event_base_| for watching when kMessagePumpIOUring is enabled
+  // and io_uring is available. Null otherwise.
+  std::unique_ptr<IOUringPoller> io_uring_poller_;
+#endif
+
   ThreadChecker watch_file_descriptor_caller_checker_;
 };
 
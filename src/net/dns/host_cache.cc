@@ -639,13 +639,14 @@ void HostCache::Set(const Key& key,
     result_changed =
         entry.error() == OK && (it->second.error() != entry.error() ||
                                 overall_delta != DELTA_IDENTICAL);
-    entries_.erase(it);
+    EraseEntry(it);
   } else {
     result_changed = true;
     // This loop almost always runs at most once, for total runtime
-    // O(max_entries_).  It only runs more than once if the cache was over-full
-    // due to pinned entries, and this is the first call to Set() after
-    // Invalidate().  The amortized cost remains O(size()) per call to Set().
+    // O(log(max_entries_)) plus the number of actively pinned entries skipped
+    // in |eviction_index_|.  It only runs more than once if the cache was
+    // over-full due to pinned entries, and this is the first call to Set()
+    // after Invalidate().
     while (size() >= max_entries_ && EvictOneEntry(now)) {
     }
   }
@@ -681,7 +682,22 @@ const HostCache::Key* HostCache::GetMatchingKeyForTesting(
 void HostCache::AddEntry(const Key& key, Entry&& entry) {
   DCHECK_EQ(0u, entries_.count(key));
   DCHECK(entry.pinning().has_value());
-  entries_.emplace(key, std::move(entry));
+  std::pair<int, base::TimeTicks> order(entry.network_changes(),
+                                        entry.expires());
+  auto it = entries_.emplace(key, std::move(entry)).first;
+  eviction_index_.emplace(order, &it->first);
+}
+
+HostCache::EntryMap::iterator HostCache::EraseEntry(EntryMap::iterator it) {
+  auto range = eviction_index_.equal_range(
+      {it->second.network_changes(), it->second.expires()});
+  for (auto index_it = range.first; index_it != range.second; ++index_it) {
+    if (index_it->second == &it->first) {
+      eviction_index_.erase(index_it);
+      break;
+    }
+  }
+  return entries_.erase(it);
 }
 
 void HostCache::Invalidate() {
@@ -703,6 +719,7 @@ void HostCache::clear() {
     return;
 
   entries_.clear();
+  eviction_index_.clear();
   if (delegate_)
     delegate_->ScheduleWrite();
 }
@@ -718,14 +735,12 @@ void HostCache::ClearForHosts(
 
   bool changed = false;
   for (auto it = entries_.begin(); it != entries_.end();) {
-    auto next_it = std::next(it);
-
     if (host_filter.Run(GetHostname(it->first.host))) {
-      entries_.erase(it);
+      it = EraseEntry(it);
       changed = true;
+    } else {
+      ++it;
     }
-
-    it = next_it;
   }
 
   if (delegate_ && changed)
@@ -965,29 +980,18 @@ std::unique_ptr<HostCache> HostCache::CreateDefaultCache() {
 
 bool HostCache::EvictOneEntry(base::TimeTicks now) {
   DCHECK_LT(0u, entries_.size());
-
-  absl::optional<net::HostCache::EntryMap::iterator> oldest_it;
-  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
-    const Entry& entry = it->second;
-    if (HasActivePin(entry)) {
+  DCHECK_EQ(entries_.size(), eviction_index_.size());
+
+  // Entries from before the latest network change are all stale and come
+  // first, then entries of the current network by expiration, where expired
+  // ones precede fresh ones. The first unpinned one is the oldest stale entry
+  // if there is any, and otherwise the fresh entry closest to expiring.
+  for (const auto& index_entry : eviction_index_) {
+    auto it = entries_.find(*index_entry.second);
+    DCHECK(it != entries_.end());
+    if (HasActivePin(it->second))
       continue;
-    }
-
-    if (!oldest_it) {
-      oldest_it = it;
-      continue;
-    }
-
-    const Entry& oldest = (*oldest_it)->second;
-    if ((entry.expires() < oldest.expires()) &&
-        (entry.IsStale(now, network_changes_) ||
-         !oldest.IsStale(now, network_changes_))) {
-      oldest_it = it;
-    }
-  }
-
-  if (oldest_it) {
-    entries_.erase(*oldest_it);
+    EraseEntry(it);
     return true;
   }
   return false;
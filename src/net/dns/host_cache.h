@@ -441,10 +441,17 @@ class NET_EXPORT HostCache {
   bool HasActivePin(const Entry& entry);
   // Helper to insert an Entry into the cache.
   void AddEntry(const Key& key, Entry&& entry);
+  // Helper to remove an Entry from the cache. Returns the next iterator.
+  EntryMap::iterator EraseEntry(EntryMap::iterator it);
 
   // Map from hostname (presumably in lowercase canonicalized format) to
   // a resolved result entry.
   EntryMap entries_;
+  // Entries of |entries_| ordered by network changes, then expiration, which
+  // is the order EvictOneEntry() picks them in. Points to keys in |entries_|.
+  using EvictionIndex =
+      std::multimap<std::pair<int, base::TimeTicks>, const Key*>;
+  EvictionIndex eviction_index_;
   size_t max_entries_;
   int network_changes_;
   // Number of cache entries that were restored in the last call to
@@ -189,6 +189,12 @@ class NET_EXPORT HostResolver {
     // unreachable without actually checking. See https://crbug.com/696569 for
     // further context.
     bool check_ipv6_on_wifi = true;
+
+    // If positive, requests with ResolveHostParameters::CacheUsage::ALLOWED
+    // are answered from successful cache entries that expired up to this long
+    // ago, and a background job refreshes the entry. Entries cached before
+    // the last network change are never served this way.
+    base::TimeDelta serve_stale_max_age;
   };
 
   // Factory class. Useful for classes that need to inject and override resolver
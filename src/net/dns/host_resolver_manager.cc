@@ -2880,6 +2880,7 @@ HostResolverManager::HostResolverManager(
       net_log_(net_log),
       system_dns_config_notifier_(system_dns_config_notifier),
       check_ipv6_on_wifi_(options.check_ipv6_on_wifi),
+      serve_stale_max_age_(options.serve_stale_max_age),
       last_ipv6_probe_result_(true),
       additional_resolver_flags_(0),
       allow_fallback_to_proctask_(true),
@@ -2933,6 +2934,7 @@ HostResolverManager::~HostResolverManager() {
   // It's now safe for Jobs to call KillDnsTask on destruction, because
   // OnJobComplete will not start any new jobs.
   jobs_.clear();
+  stale_refresh_requests_.clear();
 
   NetworkChangeNotifier::RemoveIPAddressObserver(this);
   NetworkChangeNotifier::RemoveConnectionTypeObserver(this);
@@ -3066,6 +3068,15 @@ void HostResolverManager::RegisterResolveContext(ResolveContext* context) {
 
 void HostResolverManager::DeregisterResolveContext(
     const ResolveContext* context) {
+  for (auto it = stale_refresh_requests_.begin();
+       it != stale_refresh_requests_.end();) {
+    auto* request = static_cast<RequestImpl*>(it->first);
+    if (request->resolve_context() == context) {
+      it = stale_refresh_requests_.erase(it);
+    } else {
+      ++it;
+    }
+  }
   registered_contexts_.RemoveObserver(context);
 }
 
@@ -3167,10 +3178,15 @@ int HostResolverManager::Resolve(RequestImpl* request) {
       // TODO(cammie): Sanitize before adding to the cache instead.
       request->SanitizeDnsAliasResults();
     }
+    bool refresh = stale_info && stale_info->is_stale() &&
+                   parameters.cache_usage ==
+                       ResolveHostParameters::CacheUsage::ALLOWED;
     if (stale_info && !request->parameters().is_speculative)
       request->set_stale_info(std::move(stale_info).value());
     request->set_error_info(results.error(),
                             false /* is_secure_network_error */);
+    if (refresh)
+      RefreshStaleResult(job_key, request);
     return HostResolver::SquashErrorCode(results.error());
   }
 
@@ -3246,6 +3262,20 @@ HostCache::Entry HostResolverManager::ResolveLocally(
 
     resolved = MaybeServeFromCache(cache, key, cache_usage, ignore_secure,
                                    source_net_log, out_stale_info);
+    if (!resolved && serve_stale_max_age_.is_positive() &&
+        cache_usage == ResolveHostParameters::CacheUsage::ALLOWED) {
+      // Serves a recently expired result while the caller refreshes it.
+      resolved = MaybeServeFromCache(
+          cache, key, ResolveHostParameters::CacheUsage::STALE_ALLOWED,
+          ignore_secure, source_net_log, out_stale_info);
+      if (resolved && (resolved->error() != OK ||
+                       out_stale_info->value().network_changes > 0 ||
+                       out_stale_info->value().expired_by >
+                           serve_stale_max_age_)) {
+        resolved = absl::nullopt;
+        *out_stale_info = absl::nullopt;
+      }
+    }
     if (resolved) {
       // |MaybeServeFromCache()| will update |*out_stale_info| as needed.
       DCHECK(out_stale_info->has_value());
@@ -3294,6 +3324,35 @@ void HostResolverManager::CreateAndStartJob(JobKey key,
   }
 }
 
+void HostResolverManager::RefreshStaleResult(const JobKey& job_key,
+                                             RequestImpl* request) {
+  if (jobs_.find(job_key) != jobs_.end())
+    return;
+
+  ResolveHostParameters parameters = request->parameters();
+  parameters.cache_usage = ResolveHostParameters::CacheUsage::DISALLOWED;
+  parameters.initial_priority = LOWEST;
+  parameters.is_speculative = true;
+  auto refresh_request =
+      CreateRequest(request->request_host(), request->network_isolation_key(),
+                    request->source_net_log(), std::move(parameters),
+                    request->resolve_context(), request->host_cache());
+  auto* refresh_request_ptr = refresh_request.get();
+  int rv = refresh_request->Start(
+      base::BindOnce(&HostResolverManager::OnStaleRefreshComplete,
+                     weak_ptr_factory_.GetWeakPtr(), refresh_request_ptr));
+  if (rv == ERR_IO_PENDING) {
+    stale_refresh_requests_.emplace(refresh_request_ptr,
+                                    std::move(refresh_request));
+  }
+}
+
+void HostResolverManager::OnStaleRefreshComplete(
+    CancellableResolveHostRequest* request,
+    int result) {
+  stale_refresh_requests_.erase(request);
+}
+
 HostCache::Entry HostResolverManager::ResolveAsIP(DnsQueryType query_type,
                                                   bool resolve_canonname,
                                                   const IPAddress& ip_address) {
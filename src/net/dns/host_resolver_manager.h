@@ -304,6 +304,12 @@ class NET_EXPORT HostResolverManager
                          std::deque<TaskType> tasks,
                          RequestImpl* request);
 
+  // Starts a background request that refreshes the cache entry |request| was
+  // served stale from, unless a Job for |job_key| is already running.
+  void RefreshStaleResult(const JobKey& job_key, RequestImpl* request);
+  void OnStaleRefreshComplete(CancellableResolveHostRequest* request,
+                              int result);
+
   // Resolves the IP literal hostname represented by `ip_address`.
   HostCache::Entry ResolveAsIP(DnsQueryType query_type,
                                bool resolve_canonname,
@@ -472,6 +478,14 @@ class NET_EXPORT HostResolverManager
   // WiFi connection. See https://crbug.com/696569 for further context.
   bool check_ipv6_on_wifi_;
 
+  // See ManagerOptions::serve_stale_max_age.
+  base::TimeDelta serve_stale_max_age_;
+
+  // Background requests started by RefreshStaleResult().
+  std::map<CancellableResolveHostRequest*,
+           std::unique_ptr<CancellableResolveHostRequest>>
+      stale_refresh_requests_;
+
   base::TimeTicks last_ipv6_probe_time_;
   bool last_ipv6_probe_result_;
 
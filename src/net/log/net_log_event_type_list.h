@@ -2540,6 +2540,13 @@ EVENT_TYPE(SOCKS5_GREET_WRITE)
 // The time spent waiting for the "greeting" response from the SOCKS server.
 EVENT_TYPE(SOCKS5_GREET_READ)
 
+// The time spent sending the username/password subnegotiation to the SOCKS
+// server.
+EVENT_TYPE(SOCKS5_AUTH_WRITE)
+
+// The time spent waiting for the subnegotiation response.
+EVENT_TYPE(SOCKS5_AUTH_READ)
+
 // The time spent sending the CONNECT request to the SOCKS server.
 EVENT_TYPE(SOCKS5_HANDSHAKE_WRITE)
 
@@ -62,6 +62,24 @@ namespace net {
 
 namespace {
 
+const char* CongestionControlTypeToString(quic::CongestionControlType type) {
+  switch (type) {
+    case quic::kCubicBytes:
+      return "cubic";
+    case quic::kRenoBytes:
+      return "reno";
+    case quic::kBBR:
+      return "bbr";
+    case quic::kPCC:
+      return "pcc";
+    case quic::kGoogCC:
+      return "goog_cc";
+    case quic::kBBRv2:
+      return "bbr2";
+  }
+  return "unknown";
+}
+
 // IPv6 packets have an additional 20 bytes of overhead than IPv4 packets.
 const size_t kAdditionalOverheadForIPv6 = 20;
 
@@ -920,6 +938,7 @@ QuicChromiumClientSession::QuicChromiumClientSession(
     quic::QuicTime::Delta retransmittable_on_wire_timeout,
     bool migrate_idle_session,
     bool allow_port_migration,
+    base::TimeDelta port_migration_period,
     base::TimeDelta idle_migration_period,
     base::TimeDelta max_time_on_non_default_network,
     int max_migrations_to_non_default_network_on_write_error,
@@ -1029,6 +1048,13 @@ QuicChromiumClientSession::QuicChromiumClientSession(
   connection->set_debug_visitor(logger_.get());
   connection->set_creator_debug_delegate(logger_.get());
   migrate_back_to_default_timer_.SetTaskRunner(task_runner_);
+  if (allow_port_migration_ && port_migration_period.is_positive()) {
+    port_migration_timer_.SetTaskRunner(task_runner_);
+    port_migration_timer_.Start(
+        FROM_HERE, port_migration_period,
+        base::BindRepeating(&QuicChromiumClientSession::OnPortMigrationTimer,
+                            base::Unretained(this)));
+  }
   net_log_.BeginEvent(NetLogEventType::QUIC_SESSION, [&] {
     return NetLogQuicClientSessionParams(
         &session_key, connection_id(), connection->client_connection_id(),
@@ -2977,6 +3003,25 @@ void QuicChromiumClientSession::MaybeMigrateToDifferentPortOnPathDegrading() {
   net_log_.EndEvent(NetLogEventType::QUIC_PORT_MIGRATION_TRIGGERED);
 }
 
+void QuicChromiumClientSession::OnPortMigrationTimer() {
+  // Port migration is disabled after a stateless reset on the probing path.
+  if (!allow_port_migration_) {
+    port_migration_timer_.Stop();
+    return;
+  }
+
+  const bool is_handshake_confirmed = version().UsesHttp3()
+                                          ? connection()->IsHandshakeConfirmed()
+                                          : OneRttKeysAvailable();
+  if (!is_handshake_confirmed || !HasActiveRequestStreams())
+    return;
+
+  // Goes through the same probing as on path degrading. A probe already in
+  // flight to the same peer is not restarted.
+  current_migration_cause_ = CHANGE_PORT_ON_PATH_DEGRADING;
+  MaybeMigrateToDifferentPortOnPathDegrading();
+}
+
 void QuicChromiumClientSession::
     MaybeMigrateToAlternateNetworkOnPathDegrading() {
   net_log_.AddEvent(
@@ -3406,6 +3451,20 @@ base::Value QuicChromiumClientSession::GetInfoAsValue(
   dict.SetIntKey("packets_sent", stats.packets_sent);
   dict.SetIntKey("packets_received", stats.packets_received);
   dict.SetIntKey("packets_lost", stats.packets_lost);
+  const quic::QuicSentPacketManager& sent_packet_manager =
+      connection()->sent_packet_manager();
+  dict.SetStringKey(
+      "congestion_control",
+      CongestionControlTypeToString(
+          sent_packet_manager.GetSendAlgorithm()->GetCongestionControlType()));
+  dict.SetIntKey("congestion_window",
+                 sent_packet_manager.GetCongestionWindowInBytes());
+  dict.SetIntKey("bytes_retransmitted", stats.bytes_retransmitted);
+  dict.SetIntKey("min_rtt_us", stats.min_rtt_us);
+  dict.SetIntKey("srtt_us", stats.srtt_us);
+  dict.SetIntKey("estimated_bandwidth_kbps",
+                 sent_packet_manager.BandwidthEstimate().ToKBitsPerSecond());
+  dict.SetIntKey("max_packet_length", connection()->max_packet_length());
   SSLInfo ssl_info;
 
   std::vector<base::Value> alias_list;
@@ -207,6 +207,13 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
     // Returns true if the handshake has been confirmed.
     bool OneRttKeysAvailable() const;
 
+    // Waits for the handshake to be confirmed and invokes |callback| when
+    // that happens. If the handshake has already been confirmed, returns OK.
+    // If the connection has already been closed, returns a net error. If the
+    // connection closes before the handshake is confirmed, |callback| will
+    // be invoked with an error.
+    int WaitForHandshakeConfirmation(CompletionOnceCallback callback);
+
     // Starts a request to rendezvous with a promised a stream.  If OK is
     // returned, then |push_stream_| will be updated with the promised
     // stream.  If ERR_IO_PENDING is returned, then when the rendezvous is
@@ -297,13 +304,6 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
     friend class QuicChromiumClientSession;
     friend class QuicChromiumClientSession::StreamRequest;
 
-    // Waits for the handshake to be confirmed and invokes |callback| when
-    // that happens. If the handshake has already been confirmed, returns OK.
-    // If the connection has already been closed, returns a net error. If the
-    // connection closes before the handshake is confirmed, |callback| will
-    // be invoked with an error.
-    int WaitForHandshakeConfirmation(CompletionOnceCallback callback);
-
     // Called when the handshake is confirmed.
     void OnCryptoHandshakeConfirmed();
 
@@ -556,6 +556,7 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
       quic::QuicTime::Delta retransmittable_on_wire_timeout,
       bool migrate_idle_session,
       bool allow_port_migration,
+      base::TimeDelta port_migration_period,
       base::TimeDelta idle_migration_period,
       base::TimeDelta max_time_on_non_default_network,
       int max_migrations_to_non_default_network_on_write_error,
@@ -928,6 +929,10 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
   // Helper method to initiate a port migration on path degrading is detected.
   void MaybeMigrateToDifferentPortOnPathDegrading();
 
+  // Called every |port_migration_period| to migrate to a different port
+  // before the current NAT mapping expires.
+  void OnPortMigrationTimer();
+
   // Called when there is only one possible working network: |network|, If any
   // error encountered, this session will be closed.
   // When the migration succeeds:
@@ -1055,6 +1060,7 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
   QuicConnectivityProbingManager probing_manager_;
   int retry_migrate_back_count_;
   base::OneShotTimer migrate_back_to_default_timer_;
+  base::RepeatingTimer port_migration_timer_;
   MigrationCause current_migration_cause_;
   // True if a packet needs to be sent when packet writer is unblocked to
   // complete connection migration. The packet can be a cached packet if
@@ -24,6 +24,8 @@
 #include "net/third_party/quiche/src/quic/core/http/spdy_utils.h"
 #include "net/third_party/quiche/src/quic/core/quic_utils.h"
 #include "net/third_party/quiche/src/quic/core/quic_write_blocked_list.h"
+#include "net/third_party/quiche/src/quic/platform/api/quic_mem_slice.h"
+#include "third_party/abseil-cpp/absl/types/span.h"
 
 namespace net {
 namespace {
@@ -103,6 +105,14 @@ void QuicChromiumClientStream::Handle::OnDataAvailable() {
   if (!read_body_callback_)
     return;  // Wait for ReadBody to be called.
 
+  if (!read_body_buffer_) {
+    // ReadBodyIfReady() is pending. Let the caller read with its own buffer.
+    if (!stream_->IsDoneReading() && !stream_->HasBytesToRead())
+      return;
+    ResetAndRun(std::move(read_body_callback_), OK);
+    return;
+  }
+
   int rv = stream_->Read(read_body_buffer_, read_body_buffer_len_);
   if (rv == ERR_IO_PENDING)
     return;  // Spurrious, likely because of trailers?
@@ -213,6 +223,32 @@ int QuicChromiumClientStream::Handle::ReadBody(
   return ERR_IO_PENDING;
 }
 
+int QuicChromiumClientStream::Handle::ReadBodyIfReady(
+    IOBuffer* buffer,
+    int buffer_len,
+    CompletionOnceCallback callback) {
+  ScopedBoolSaver saver(&may_invoke_callbacks_, false);
+  if (IsDoneReading())
+    return OK;
+
+  if (!stream_)
+    return net_error_;
+
+  int rv = stream_->Read(buffer, buffer_len);
+  if (rv != ERR_IO_PENDING)
+    return rv;
+
+  SetCallback(std::move(callback), &read_body_callback_);
+  read_body_buffer_ = nullptr;
+  read_body_buffer_len_ = 0;
+  return ERR_IO_PENDING;
+}
+
+void QuicChromiumClientStream::Handle::CancelReadBodyIfReady() {
+  DCHECK(!read_body_buffer_);
+  read_body_callback_.Reset();
+}
+
 int QuicChromiumClientStream::Handle::ReadTrailingHeaders(
     spdy::Http2HeaderBlock* header_block,
     CompletionOnceCallback callback) {
@@ -271,6 +307,22 @@ int QuicChromiumClientStream::Handle::WritevStreamData(
   return ERR_IO_PENDING;
 }
 
+int QuicChromiumClientStream::Handle::WriteStreamIOBuffer(
+    scoped_refptr<IOBuffer> buffer,
+    int length,
+    bool fin,
+    CompletionOnceCallback callback) {
+  ScopedBoolSaver saver(&may_invoke_callbacks_, false);
+  if (!stream_)
+    return net_error_;
+
+  if (stream_->WriteStreamIOBuffer(std::move(buffer), length, fin))
+    return HandleIOComplete(OK);
+
+  SetCallback(std::move(callback), &write_callback_);
+  return ERR_IO_PENDING;
+}
+
 int QuicChromiumClientStream::Handle::Read(IOBuffer* buf, int buf_len) {
   if (!stream_)
     return net_error_;
@@ -656,6 +708,24 @@ bool QuicChromiumClientStream::WritevStreamData(
   return !HasBufferedData();  // Was all data written?
 }
 
+bool QuicChromiumClientStream::WriteStreamIOBuffer(
+    scoped_refptr<IOBuffer> buffer,
+    int length,
+    bool fin) {
+  // For gQUIC, this must not be called when data is buffered because headers
+  // are sent on the dedicated header stream.
+  DCHECK(!HasBufferedData() || VersionUsesHttp3(quic_version_));
+  quic::QuicMemSlice slice(quic::QuicMemSliceImpl(std::move(buffer), length));
+  quic::QuicConsumedData consumed =
+      WriteBodySlices(absl::MakeSpan(&slice, 1), fin);
+  if (consumed.bytes_consumed == 0) {
+    // Not accepted because too much data is buffered. Buffers a copy like
+    // WriteStreamData() instead.
+    WriteOrBufferBody(absl::string_view(slice.data(), slice.length()), fin);
+  }
+  return !HasBufferedData();  // Was all data written?
+}
+
 std::unique_ptr<QuicChromiumClientStream::Handle>
 QuicChromiumClientStream::CreateHandle() {
   DCHECK(!handle_);
@@ -68,6 +68,16 @@ class NET_EXPORT_PRIVATE QuicChromiumClientStream
                  int buffer_len,
                  CompletionOnceCallback callback);
 
+    // Like ReadBody(), but if body is not available, does not hold on to
+    // |buffer| and invokes |callback| with OK when data arrive, at which point
+    // the caller reads again.
+    int ReadBodyIfReady(IOBuffer* buffer,
+                        int buffer_len,
+                        CompletionOnceCallback callback);
+
+    // Cancels a pending ReadBodyIfReady().
+    void CancelReadBodyIfReady();
+
     // Reads trailing headers into |header_block| and returns the length of
     // the HEADERS frame which contained them. If headers are not available,
     // returns ERR_IO_PENDING and will invoke |callback| asynchronously when
@@ -102,6 +112,14 @@ class NET_EXPORT_PRIVATE QuicChromiumClientStream
                          bool fin,
                          CompletionOnceCallback callback);
 
+    // Same as WriteStreamData except the stream keeps a reference to |buffer|
+    // until the data is acknowledged instead of copying it. The contents of
+    // |buffer| must not change afterwards.
+    int WriteStreamIOBuffer(scoped_refptr<IOBuffer> buffer,
+                            int length,
+                            bool fin,
+                            CompletionOnceCallback callback);
+
     // Reads at most |buf_len| bytes into |buf|. Returns the number of bytes
     // read.
     int Read(IOBuffer* buf, int buf_len);
@@ -267,6 +285,11 @@ class NET_EXPORT_PRIVATE QuicChromiumClientStream
   bool WritevStreamData(const std::vector<scoped_refptr<IOBuffer>>& buffers,
                         const std::vector<int>& lengths,
                         bool fin);
+  // Same as WriteStreamData except it saves |buffer| in the send buffer
+  // without copying.
+  bool WriteStreamIOBuffer(scoped_refptr<IOBuffer> buffer,
+                           int length,
+                           bool fin);
 
   // Creates a new Handle for this stream. Must only be called once.
   std::unique_ptr<QuicChromiumClientStream::Handle> CreateHandle();
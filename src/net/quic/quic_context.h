@@ -93,6 +93,9 @@ struct NET_EXPORT QuicParams {
   quic::QuicTagVector client_connection_options;
   // Enables experimental optimization for receiving data in UDPSocket.
   bool enable_socket_recv_optimization = false;
+  // Flow control receive windows advertised to the peer.
+  uint32_t initial_session_flow_control_window = 15 * 1024 * 1024;
+  uint32_t initial_stream_flow_control_window = 6 * 1024 * 1024;
 
   // Active QUIC experiments
 
@@ -136,6 +139,10 @@ struct NET_EXPORT QuicParams {
   // If true, sessions with open streams will attempt to migrate to a different
   // port when the current path is poor.
   bool allow_port_migration = false;
+  // If non-zero and |allow_port_migration| is true, sessions with open streams
+  // also migrate to a different port this often, without waiting for the path
+  // to degrade. Useful behind NATs that rebind mappings periodically.
+  base::TimeDelta port_migration_period;
   // A session can be migrated if its idle time is within this period.
   base::TimeDelta idle_session_migration_period =
       kDefaultIdleSessionMigrationPeriod;
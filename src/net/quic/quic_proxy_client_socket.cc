@@ -9,7 +9,9 @@
 
 #include "base/bind.h"
 #include "base/callback_helpers.h"
+#include "base/strings/string_piece.h"
 #include "base/values.h"
+#include "net/base/io_buffer.h"
 #include "net/base/proxy_delegate.h"
 #include "net/http/http_auth_controller.h"
 #include "net/http/http_log_util.h"
@@ -22,6 +24,27 @@
 
 namespace net {
 
+namespace {
+
+// Pinning keeps the caller's whole buffer, 64 KiB for naive's relay, until the
+// data is acknowledged, so smaller writes are copied into the send buffer.
+constexpr int kMinPinnedWriteSize = 16 * 1024;
+
+// Keeps |buffer| alive and fixes its current data pointer, which
+// DrainableIOBuffer moves on DidConsume().
+class PinnedIOBuffer : public WrappedIOBuffer {
+ public:
+  explicit PinnedIOBuffer(scoped_refptr<IOBuffer> buffer)
+      : WrappedIOBuffer(buffer->data()), buffer_(std::move(buffer)) {}
+
+ private:
+  ~PinnedIOBuffer() override = default;
+
+  scoped_refptr<IOBuffer> buffer_;
+};
+
+}  // namespace
+
 QuicProxyClientSocket::QuicProxyClientSocket(
     std::unique_ptr<QuicChromiumClientStream::Handle> stream,
     std::unique_ptr<QuicChromiumClientSession::Handle> session,
@@ -42,6 +65,8 @@ QuicProxyClientSocket::QuicProxyClientSocket(
       proxy_delegate_(proxy_delegate),
       user_agent_(user_agent),
       use_fastopen_(false),
+      allow_early_data_(false),
+      pin_writes_(false),
       read_headers_pending_(false),
       net_log_(net_log) {
   DCHECK(stream_->IsOpen());
@@ -205,13 +230,54 @@ int QuicProxyClientSocket::Read(IOBuffer* buf,
   return rv;
 }
 
+int QuicProxyClientSocket::ReadIfReady(IOBuffer* buf,
+                                       int buf_len,
+                                       CompletionOnceCallback callback) {
+  DCHECK(connect_callback_.is_null());
+  DCHECK(read_callback_.is_null());
+  DCHECK(!read_buf_);
+
+  if (next_state_ == STATE_DISCONNECTED)
+    return ERR_SOCKET_NOT_CONNECTED;
+
+  if (!stream_->IsOpen()) {
+    return 0;
+  }
+
+  int rv = stream_->ReadBodyIfReady(
+      buf, buf_len,
+      base::BindOnce(&QuicProxyClientSocket::OnReadComplete,
+                     weak_factory_.GetWeakPtr()));
+
+  if (rv == ERR_IO_PENDING) {
+    // |read_buf_| stays null, the caller reads again on completion.
+    read_callback_ = std::move(callback);
+  } else if (rv == 0) {
+    net_log_.AddByteTransferEvent(NetLogEventType::SOCKET_BYTES_RECEIVED, 0,
+                                  nullptr);
+  } else if (rv > 0) {
+    net_log_.AddByteTransferEvent(NetLogEventType::SOCKET_BYTES_RECEIVED, rv,
+                                  buf->data());
+  }
+  return rv;
+}
+
+int QuicProxyClientSocket::CancelReadIfReady() {
+  // Only a pending ReadIfReady() can be canceled.
+  DCHECK(!read_buf_);
+  if (read_callback_) {
+    stream_->CancelReadBodyIfReady();
+    read_callback_.Reset();
+  }
+  return OK;
+}
+
 void QuicProxyClientSocket::OnReadComplete(int rv) {
   if (!stream_->IsOpen())
     rv = 0;
 
   if (!read_callback_.is_null()) {
-    DCHECK(read_buf_);
-    if (rv >= 0) {
+    if (rv >= 0 && read_buf_) {
       net_log_.AddByteTransferEvent(NetLogEventType::SOCKET_BYTES_RECEIVED, rv,
                                     read_buf_->data());
     }
@@ -234,10 +300,24 @@ int QuicProxyClientSocket::Write(
   net_log_.AddByteTransferEvent(NetLogEventType::SOCKET_BYTES_SENT, buf_len,
                                 buf->data());
 
-  int rv = stream_->WriteStreamData(
-      base::StringPiece(buf->data(), buf_len), false,
-      base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
-                     weak_factory_.GetWeakPtr()));
+  // On a resumed session the CONNECT request goes out as 0-RTT data, which
+  // is fine to replay: the proxy only dials the origin again. The payload
+  // may not be, so it is held until the handshake is confirmed unless early
+  // data is explicitly allowed.
+  if (!allow_early_data_ && !session_->OneRttKeysAvailable()) {
+    int rv = session_->WaitForHandshakeConfirmation(base::BindOnce(
+        &QuicProxyClientSocket::OnHandshakeConfirmedForWrite,
+        weak_factory_.GetWeakPtr(), base::WrapRefCounted(buf), buf_len));
+    if (rv == ERR_IO_PENDING) {
+      write_callback_ = std::move(callback);
+      write_buf_len_ = buf_len;
+      return rv;
+    }
+    if (rv != OK)
+      return rv;
+  }
+
+  int rv = WriteStream(buf, buf_len);
   if (rv == OK)
     return buf_len;
 
@@ -249,6 +329,36 @@ int QuicProxyClientSocket::Write(
   return rv;
 }
 
+int QuicProxyClientSocket::WriteStream(IOBuffer* buf, int buf_len) {
+  if (!pin_writes_ || buf_len < kMinPinnedWriteSize) {
+    return stream_->WriteStreamData(
+        base::StringPiece(buf->data(), buf_len), false,
+        base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
+                       weak_factory_.GetWeakPtr()));
+  }
+
+  // Saves |buf| in the stream's send buffer until acknowledged instead of
+  // copying it. See |pin_writes_| for what this requires of the caller.
+  return stream_->WriteStreamIOBuffer(
+      base::MakeRefCounted<PinnedIOBuffer>(buf), buf_len, false,
+      base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
+                     weak_factory_.GetWeakPtr()));
+}
+
+void QuicProxyClientSocket::OnHandshakeConfirmedForWrite(
+    scoped_refptr<IOBuffer> buf,
+    int buf_len,
+    int rv) {
+  // Disconnected while waiting.
+  if (write_callback_.is_null())
+    return;
+
+  if (rv == OK)
+    rv = WriteStream(buf.get(), buf_len);
+  if (rv != ERR_IO_PENDING)
+    OnWriteComplete(rv);
+}
+
 void QuicProxyClientSocket::OnWriteComplete(int rv) {
   if (!write_callback_.is_null()) {
     if (rv == OK)
@@ -373,6 +483,14 @@ int QuicProxyClientSocket::DoSendRequest() {
       // TODO(klzgrad): look into why Fast Open does not work.
       use_fastopen_ = true;
     }
+    if (proxy_delegate_headers.HasHeader("early-payload")) {
+      proxy_delegate_headers.RemoveHeader("early-payload");
+      allow_early_data_ = true;
+    }
+    if (proxy_delegate_headers.HasHeader("pin-writes")) {
+      proxy_delegate_headers.RemoveHeader("pin-writes");
+      pin_writes_ = true;
+    }
     request_.extra_headers.MergeFrom(proxy_delegate_headers);
   }
 
@@ -9,6 +9,7 @@
 #include <memory>
 #include <string>
 
+#include "base/memory/scoped_refptr.h"
 #include "net/base/completion_once_callback.h"
 #include "net/base/proxy_server.h"
 #include "net/http/proxy_client_socket.h"
@@ -25,6 +26,11 @@ class ProxyDelegate;
 // QuicProxyClientSocket provides a socket interface to an underlying
 // QuicChromiumClientStream. Bytes written to/read from a QuicProxyClientSocket
 // are sent/received via STREAM frames in the underlying QUIC stream.
+//
+// If the proxy delegate adds a "pin-writes" header, writes of 16 KiB or more
+// are not copied: the socket keeps a reference to the written IOBuffer and
+// may read it again until the data is acknowledged, after Write() completes.
+// Callers must then not modify a buffer they wrote while it is still shared.
 class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
  public:
   // Create a socket on top of the |stream| by sending a HEADERS CONNECT
@@ -74,6 +80,10 @@ class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
   int Read(IOBuffer* buf,
            int buf_len,
            CompletionOnceCallback callback) override;
+  int ReadIfReady(IOBuffer* buf,
+                  int buf_len,
+                  CompletionOnceCallback callback) override;
+  int CancelReadIfReady() override;
   int Write(IOBuffer* buf,
             int buf_len,
             CompletionOnceCallback callback,
@@ -98,6 +108,11 @@ class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
   void OnIOComplete(int result);  // Callback used during connecting
   void OnReadComplete(int rv);
   void OnWriteComplete(int rv);
+  int WriteStream(IOBuffer* buf, int buf_len);
+  // Callback for session_->WaitForHandshakeConfirmation() in Write().
+  void OnHandshakeConfirmedForWrite(scoped_refptr<IOBuffer> buf,
+                                    int buf_len,
+                                    int rv);
 
   // Callback for stream_->ReadInitialHeaders()
   void OnReadResponseHeadersComplete(int result);
@@ -152,6 +167,11 @@ class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
   LoadTimingInfo::ConnectTiming connect_timing_;
 
   bool use_fastopen_;
+  // Whether the payload may be sent before the handshake is confirmed.
+  bool allow_early_data_;
+  // Whether large writes keep the caller's buffer instead of copying it. Set
+  // by the "pin-writes" header; see the class comment.
+  bool pin_writes_;
   bool read_headers_pending_;
 
   const NetLogWithSource net_log_;
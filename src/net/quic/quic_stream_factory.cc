@@ -1191,6 +1191,20 @@ bool QuicStreamFactory::CanUseExistingSession(
   return false;
 }
 
+QuicChromiumClientSession* QuicStreamFactory::FindActiveSession(
+    const HostPortPair& server,
+    const NetworkIsolationKey& network_isolation_key) const {
+  for (const auto& key_value : active_sessions_) {
+    const QuicSessionKey& key = key_value.first;
+    if (key.server_id().host() == server.host() &&
+        key.server_id().port() == server.port() &&
+        key.network_isolation_key() == network_isolation_key) {
+      return key_value.second;
+    }
+  }
+  return nullptr;
+}
+
 int QuicStreamFactory::Create(const QuicSessionKey& session_key,
                               url::SchemeHostPort destination,
                               quic::ParsedQuicVersion quic_version,
@@ -1831,7 +1845,8 @@ int QuicStreamFactory::CreateSession(
       params_.migrate_sessions_early_v2,
       params_.migrate_sessions_on_network_change_v2, default_network_,
       retransmittable_on_wire_timeout_, params_.migrate_idle_sessions,
-      params_.allow_port_migration, params_.idle_session_migration_period,
+      params_.allow_port_migration, params_.port_migration_period,
+      params_.idle_session_migration_period,
       params_.max_time_on_non_default_network,
       params_.max_migrations_to_non_default_network_on_write_error,
       params_.max_migrations_to_non_default_network_on_path_degrading,
@@ -260,6 +260,12 @@ class NET_EXPORT_PRIVATE QuicStreamFactory
   bool CanUseExistingSession(const QuicSessionKey& session_key,
                              const url::SchemeHostPort& destination);
 
+  // Returns the active session to |server| partitioned by
+  // |network_isolation_key|, or nullptr if there is none.
+  QuicChromiumClientSession* FindActiveSession(
+      const HostPortPair& server,
+      const NetworkIsolationKey& network_isolation_key) const;
+
   // Fetches a QuicChromiumClientSession to |host_port_pair| which will be
   // owned by |request|.
   // If a matching session already exists, this method will return OK.  If no
@@ -294,7 +294,7 @@ int InitSocketHandleForRawConnect2(const HostPortPair& endpoint,
       request_priority, session, proxy_info, ssl_config_for_origin,
       ssl_config_for_proxy,
       /*is_for_websockets=*/true, privacy_mode,
-      std::move(network_isolation_key), SecureDnsPolicy::kDisable, SocketTag(),
+      std::move(network_isolation_key), SecureDnsPolicy::kAllow, SocketTag(),
       net_log, 0, socket_handle, HttpNetworkSession::NORMAL_SOCKET_POOL,
       std::move(callback), ClientSocketPool::ProxyAuthCallback());
 }
@@ -5,6 +5,7 @@
 
 #include "net/tools/naive/http_proxy_socket.h"
 
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -12,10 +13,11 @@
 #include "base/callback_helpers.h"
 #include "base/logging.h"
 #include "base/rand_util.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/string_util.h"
 #include "base/sys_byteorder.h"
 #include "net/base/ip_address.h"
 #include "net/base/net_errors.h"
-#include "net/http/http_request_headers.h"
 #include "net/log/net_log.h"
 #include "net/third_party/quiche/src/spdy/core/hpack/hpack_constants.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
@@ -23,13 +25,33 @@
 namespace net {
 
 namespace {
-constexpr int kBufferSize = 64 * 1024;
+constexpr int kBufferSize = 16 * 1024;
 constexpr size_t kMaxHeaderSize = 64 * 1024;
+constexpr char kHeaderEnd[] = "\r\n\r\n";
+constexpr size_t kHeaderEndSize = sizeof(kHeaderEnd) - 1;
 constexpr char kResponseHeader[] = "HTTP/1.1 200 OK\r\nPadding: ";
 constexpr int kResponseHeaderSize = sizeof(kResponseHeader) - 1;
 // A plain 200 is 10 bytes. Expected 48 bytes. "Padding" uses up 7 bytes.
 constexpr int kMinPaddingSize = 30;
 constexpr int kMaxPaddingSize = kMinPaddingSize + 32;
+
+// Returns the position of "\r\n\r\n" in |data| at or after |from|, or npos.
+// memchr() is vectorized in libc, which makes skipping over long header
+// values cheap.
+size_t FindHeaderEnd(base::StringPiece data, size_t from) {
+  const char* begin = data.data();
+  const char* end = data.data() + data.size();
+  const char* p = begin + from;
+  while (end - p >= static_cast<ptrdiff_t>(kHeaderEndSize)) {
+    p = static_cast<const char*>(std::memchr(p, '\r', end - p));
+    if (p == nullptr || end - p < static_cast<ptrdiff_t>(kHeaderEndSize))
+      break;
+    if (std::memcmp(p, kHeaderEnd, kHeaderEndSize) == 0)
+      return p - begin;
+    ++p;
+  }
+  return base::StringPiece::npos;
+}
 }  // namespace
 
 HttpProxySocket::HttpProxySocket(
@@ -41,6 +63,8 @@ HttpProxySocket::HttpProxySocket(
       transport_(std::move(transport_socket)),
       padding_detector_delegate_(padding_detector_delegate),
       next_state_(STATE_NONE),
+      buffer_offset_(0),
+      header_scan_offset_(0),
       completed_handshake_(false),
       was_ever_used_(false),
       header_write_size_(-1),
@@ -66,6 +90,8 @@ int HttpProxySocket::Connect(CompletionOnceCallback callback) {
 
   next_state_ = STATE_HEADER_READ;
   buffer_.clear();
+  buffer_offset_ = 0;
+  header_scan_offset_ = 0;
 
   int rv = DoLoop(OK);
   if (rv == ERR_IO_PENDING) {
@@ -146,21 +172,32 @@ int HttpProxySocket::Read(IOBuffer* buf,
   DCHECK(!user_callback_);
   DCHECK(callback);
 
-  if (!buffer_.empty()) {
+  int rv = ReadEarlyData(buf, buf_len);
+  if (rv > 0)
+    return rv;
+
+  rv = transport_->Read(
+      buf, buf_len,
+      base::BindOnce(&HttpProxySocket::OnReadWriteComplete,
+                     base::Unretained(this), std::move(callback)));
+  if (rv > 0)
     was_ever_used_ = true;
-    int data_len = buffer_.size();
-    if (data_len <= buf_len) {
-      std::memcpy(buf->data(), buffer_.data(), data_len);
-      buffer_.clear();
-      return data_len;
-    } else {
-      std::memcpy(buf->data(), buffer_.data(), buf_len);
-      buffer_ = buffer_.substr(buf_len);
-      return buf_len;
-    }
-  }
+  return rv;
+}
+
+int HttpProxySocket::ReadIfReady(IOBuffer* buf,
+                                 int buf_len,
+                                 CompletionOnceCallback callback) {
+  DCHECK(completed_handshake_);
+  DCHECK_EQ(STATE_NONE, next_state_);
+  DCHECK(!user_callback_);
+  DCHECK(callback);
 
-  int rv = transport_->Read(
+  int rv = ReadEarlyData(buf, buf_len);
+  if (rv > 0)
+    return rv;
+
+  rv = transport_->ReadIfReady(
       buf, buf_len,
       base::BindOnce(&HttpProxySocket::OnReadWriteComplete,
                      base::Unretained(this), std::move(callback)));
@@ -169,6 +206,10 @@ int HttpProxySocket::Read(IOBuffer* buf,
   return rv;
 }
 
+int HttpProxySocket::CancelReadIfReady() {
+  return transport_->CancelReadIfReady();
+}
+
 // Write is called by the transport layer. This can only be done if the
 // SOCKS handshake is complete.
 int HttpProxySocket::Write(
@@ -226,6 +267,22 @@ void HttpProxySocket::OnReadWriteComplete(CompletionOnceCallback callback,
   std::move(callback).Run(result);
 }
 
+int HttpProxySocket::ReadEarlyData(IOBuffer* buf, int buf_len) {
+  if (buffer_offset_ >= buffer_.size())
+    return 0;
+
+  was_ever_used_ = true;
+  int data_len = std::min<size_t>(buffer_.size() - buffer_offset_, buf_len);
+  std::memcpy(buf->data(), buffer_.data() + buffer_offset_, data_len);
+  buffer_offset_ += data_len;
+  if (buffer_offset_ == buffer_.size()) {
+    // Releases the memory.
+    std::string().swap(buffer_);
+    buffer_offset_ = 0;
+  }
+  return data_len;
+}
+
 int HttpProxySocket::DoLoop(int last_io_result) {
   DCHECK_NE(next_state_, STATE_NONE);
   int rv = last_io_result;
@@ -259,7 +316,8 @@ int HttpProxySocket::DoLoop(int last_io_result) {
 int HttpProxySocket::DoHeaderRead() {
   next_state_ = STATE_HEADER_READ_COMPLETE;
 
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(kBufferSize);
+  if (!handshake_buf_)
+    handshake_buf_ = base::MakeRefCounted<IOBuffer>(kBufferSize);
   return transport_->Read(handshake_buf_.get(), kBufferSize, io_callback_);
 }
 
@@ -272,50 +330,88 @@ int HttpProxySocket::DoHeaderReadComplete(int result) {
   }
 
   buffer_.append(handshake_buf_->data(), result);
-  if (buffer_.size() > kMaxHeaderSize) {
-    return ERR_MSG_TOO_BIG;
-  }
 
-  auto header_end = buffer_.find("\r\n\r\n");
-  if (header_end == std::string::npos) {
+  // Resumes the search where the last one stopped, so a header trickling in
+  // byte by byte is scanned only once.
+  size_t header_end = FindHeaderEnd(buffer_, header_scan_offset_);
+  if (header_end == base::StringPiece::npos) {
+    if (buffer_.size() > kMaxHeaderSize) {
+      return ERR_MSG_TOO_BIG;
+    }
+    // The delimiter may straddle the next read.
+    header_scan_offset_ = buffer_.size() >= kHeaderEndSize - 1
+                              ? buffer_.size() - (kHeaderEndSize - 1)
+                              : 0;
     next_state_ = STATE_HEADER_READ;
     return OK;
   }
+  if (header_end > kMaxHeaderSize) {
+    return ERR_MSG_TOO_BIG;
+  }
+
+  int rv = ParseHeader(header_end);
+  if (rv != OK)
+    return rv;
+
+  // The early data after the header is returned by Read() in place.
+  buffer_offset_ = header_end + kHeaderEndSize;
+  if (buffer_offset_ == buffer_.size()) {
+    std::string().swap(buffer_);
+    buffer_offset_ = 0;
+  }
+
+  next_state_ = STATE_HEADER_WRITE;
+  return OK;
+}
+
+// Only extracts the request target and whether there is a padding header.
+int HttpProxySocket::ParseHeader(size_t header_end) {
+  base::StringPiece header(buffer_.data(), header_end);
 
   // HttpProxyClientSocket uses CONNECT for all endpoints.
-  auto first_line_end = buffer_.find("\r\n");
-  auto first_space = buffer_.find(' ');
-  if (first_space == std::string::npos || first_space + 1 >= first_line_end) {
+  size_t first_line_end = header.find("\r\n");
+  base::StringPiece first_line = header.substr(0, first_line_end);
+  size_t first_space = first_line.find(' ');
+  if (first_space == base::StringPiece::npos ||
+      first_space + 1 >= first_line.size()) {
     return ERR_INVALID_ARGUMENT;
   }
-  if (buffer_.compare(0, first_space, "CONNECT") != 0) {
+  if (first_line.substr(0, first_space) != "CONNECT") {
     return ERR_INVALID_ARGUMENT;
   }
-  auto second_space = buffer_.find(' ', first_space + 1);
-  if (second_space == std::string::npos || second_space >= first_line_end) {
+  size_t second_space = first_line.find(' ', first_space + 1);
+  if (second_space == base::StringPiece::npos) {
     return ERR_INVALID_ARGUMENT;
   }
   request_endpoint_ = HostPortPair::FromString(
-      buffer_.substr(first_space + 1, second_space - (first_space + 1)));
-
-  auto second_line = first_line_end + 2;
-  HttpRequestHeaders headers;
-  std::string headers_str;
-  if (second_line < header_end) {
-    headers_str = buffer_.substr(second_line, header_end - second_line);
-    headers.AddHeadersFromString(headers_str);
+      first_line.substr(first_space + 1, second_space - (first_space + 1)));
+
+  bool has_padding = false;
+  size_t line_start = first_line_end == base::StringPiece::npos
+                          ? header.size()
+                          : first_line_end + 2;
+  while (line_start < header.size()) {
+    size_t line_end = header.find("\r\n", line_start);
+    if (line_end == base::StringPiece::npos)
+      line_end = header.size();
+    base::StringPiece line = header.substr(line_start, line_end - line_start);
+    size_t colon = line.find(':');
+    if (colon != base::StringPiece::npos &&
+        base::EqualsCaseInsensitiveASCII(
+            base::TrimWhitespaceASCII(line.substr(0, colon), base::TRIM_ALL),
+            "padding")) {
+      has_padding = true;
+      break;
+    }
+    line_start = line_end + 2;
   }
-  if (headers.HasHeader("padding")) {
+  if (has_padding) {
     padding_detector_delegate_->SetClientPaddingSupport(
         PaddingSupport::kCapable);
   } else {
     padding_detector_delegate_->SetClientPaddingSupport(
         PaddingSupport::kIncapable);
   }
-
-  buffer_ = buffer_.substr(header_end + 4);
-
-  next_state_ = STATE_HEADER_WRITE;
   return OK;
 }
 
@@ -344,6 +440,7 @@ int HttpProxySocket::DoHeaderWriteComplete(int result) {
     return ERR_FAILED;
   }
 
+  handshake_buf_ = nullptr;
   completed_handshake_ = true;
   next_state_ = STATE_NONE;
   return OK;
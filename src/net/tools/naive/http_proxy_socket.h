@@ -61,6 +61,10 @@ class HttpProxySocket : public StreamSocket {
   int Read(IOBuffer* buf,
            int buf_len,
            CompletionOnceCallback callback) override;
+  int ReadIfReady(IOBuffer* buf,
+                  int buf_len,
+                  CompletionOnceCallback callback) override;
+  int CancelReadIfReady() override;
   int Write(IOBuffer* buf,
             int buf_len,
             CompletionOnceCallback callback,
@@ -85,11 +89,16 @@ class HttpProxySocket : public StreamSocket {
   void OnIOComplete(int result);
   void OnReadWriteComplete(CompletionOnceCallback callback, int result);
 
+  // Copies early data pipelined with the handshake into |buf|. Returns 0 if
+  // there is none left.
+  int ReadEarlyData(IOBuffer* buf, int buf_len);
+
   int DoLoop(int last_io_result);
   int DoHeaderWrite();
   int DoHeaderWriteComplete(int result);
   int DoHeaderRead();
   int DoHeaderReadComplete(int result);
+  int ParseHeader(size_t header_end);
 
   CompletionRepeatingCallback io_callback_;
 
@@ -107,7 +116,12 @@ class HttpProxySocket : public StreamSocket {
   // read or write.
   scoped_refptr<IOBuffer> handshake_buf_;
 
+  // Stores the header received so far, and after the handshake the early
+  // data received with the header, starting at |buffer_offset_|.
   std::string buffer_;
+  size_t buffer_offset_;
+  // Where the search for the end of header resumes after the next read.
+  size_t header_scan_offset_;
   bool completed_handshake_;
   bool was_ever_used_;
   int header_write_size_;
@@ -0,0 +1,143 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/tools/naive/naive_allocator.h"
+
+#include "base/allocator/buildflags.h"
+#include "base/bind.h"
+#include "base/check_op.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "base/time/time.h"
+
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+#include "base/allocator/allocator_shim.h"
+#include "base/allocator/allocator_shim_default_dispatch_to_partition_alloc.h"
+#include "base/allocator/partition_allocator/memory_reclaimer.h"
+#include "base/allocator/partition_allocator/partition_stats.h"
+#include "base/allocator/partition_allocator/thread_cache.h"
+#include "net/third_party/quiche/src/quic/core/quic_stream_sequencer_buffer.h"
+#endif
+
+namespace net {
+
+namespace {
+// Sequential requests from a single client open and close connections all
+// the time, so memory is only reclaimed after staying idle this long.
+constexpr base::TimeDelta kIdleReclaimDelay = base::Seconds(30);
+
+int g_active_connections = 0;
+// Bumped whenever a connection opens, which cancels pending idle reclaims.
+int g_idle_generation = 0;
+
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+class StatsLogger : public base::PartitionStatsDumper {
+ public:
+  void PartitionDumpTotals(
+      const char* partition_name,
+      const base::PartitionMemoryStats* stats) override {
+    LOG(INFO) << "Partition " << partition_name
+              << ": committed=" << stats->total_committed_bytes
+              << " max_committed=" << stats->max_committed_bytes
+              << " allocated=" << stats->total_allocated_bytes
+              << " resident=" << stats->total_resident_bytes
+              << " active=" << stats->total_active_bytes
+              << " purgeable="
+              << stats->total_decommittable_bytes +
+                     stats->total_discardable_bytes;
+    if (stats->has_thread_cache) {
+      const auto& cache = stats->all_thread_caches_stats;
+      LOG(INFO) << "Partition " << partition_name
+                << " thread caches: memory=" << cache.bucket_total_memory
+                << " allocs=" << cache.alloc_count
+                << " hits=" << cache.alloc_hits
+                << " misses=" << cache.alloc_misses;
+    }
+  }
+
+  void PartitionsDumpBucketStats(
+      const char* partition_name,
+      const base::PartitionBucketMemoryStats* stats) override {
+    if (!stats->is_valid || stats->resident_bytes == 0)
+      return;
+    LOG(INFO) << "Partition " << partition_name << " bucket "
+              << stats->bucket_slot_size
+              << (stats->is_direct_map ? " (direct map)" : "")
+              << ": committed=" << stats->allocated_slot_span_size
+              << " active=" << stats->active_bytes
+              << " resident=" << stats->resident_bytes
+              << " purgeable="
+              << stats->decommittable_bytes + stats->discardable_bytes
+              << " spans=" << stats->num_full_slot_spans << "/"
+              << stats->num_active_slot_spans << "/"
+              << stats->num_empty_slot_spans << "/"
+              << stats->num_decommitted_slot_spans;
+  }
+};
+
+void ReclaimAllIfIdle(int idle_generation) {
+  // A connection may have opened since the task was posted.
+  if (g_active_connections == 0 && idle_generation == g_idle_generation)
+    base::PartitionAllocMemoryReclaimer::Instance()->ReclaimAll();
+}
+#endif  // BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+}  // namespace
+
+void ConfigureAllocator() {
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+  // Without BackupRefPtr or a forced split this only turns on the thread
+  // cache of the existing malloc partition.
+  base::allocator::ConfigurePartitions(
+      base::allocator::EnableBrp(false),
+      base::allocator::ForceSplitPartitions(false));
+  // By default only allocations up to 512 bytes are cached. QUIC stream
+  // sequencer blocks are allocated when tunnel data arrives and freed once it
+  // is relayed, so cache up to their size to keep that churn thread-local.
+  base::ThreadCache::SetLargestCachedSize(
+      quic::QuicStreamSequencerBuffer::kBlockSizeBytes);
+#endif
+}
+
+void StartAllocatorPurging() {
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+  base::allocator::EnablePartitionAllocMemoryReclaimer();
+  base::PartitionAllocMemoryReclaimer::Instance()->Start(
+      base::ThreadTaskRunnerHandle::Get());
+  base::internal::ThreadCacheRegistry::Instance().StartPeriodicPurge();
+#endif
+}
+
+void OnConnectionOpened() {
+  ++g_active_connections;
+  ++g_idle_generation;
+}
+
+void OnConnectionClosed() {
+  DCHECK_GT(g_active_connections, 0);
+  if (--g_active_connections > 0)
+    return;
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+  base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE, base::BindOnce(&ReclaimAllIfIdle, g_idle_generation),
+      kIdleReclaimDelay);
+#endif
+}
+
+void DumpAllocatorStats() {
+#if BUILDFLAG(USE_PARTITION_ALLOC_AS_MALLOC)
+  LOG(INFO) << "Active connections: " << g_active_connections;
+  StatsLogger logger;
+  base::internal::PartitionAllocMalloc::Allocator()->DumpStats(
+      "malloc", /*is_light_dump=*/false, &logger);
+  auto* aligned = base::internal::PartitionAllocMalloc::AlignedAllocator();
+  if (aligned != base::internal::PartitionAllocMalloc::Allocator()) {
+    aligned->DumpStats("aligned", /*is_light_dump=*/false, &logger);
+  }
+#else
+  LOG(INFO) << "Allocator stats require PartitionAlloc as malloc";
+#endif
+}
+
+}  // namespace net
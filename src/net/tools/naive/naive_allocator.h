@@ -0,0 +1,27 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_ALLOCATOR_H_
+#define NET_TOOLS_NAIVE_NAIVE_ALLOCATOR_H_
+
+namespace net {
+
+// Enables the PartitionAlloc thread cache for malloc, up to the size of QUIC
+// stream buffer blocks. Must be called early, after FeatureList is initialized
+// and before other threads start. No-op if malloc is not PartitionAlloc.
+void ConfigureAllocator();
+
+// Starts periodic purging of the thread caches and free pages. Must be called
+// on the network thread.
+void StartAllocatorPurging();
+
+// Connections across all listeners. When none has been open for a while, free
+// memory is returned to the system instead of waiting for the periodic purge.
+void OnConnectionOpened();
+void OnConnectionClosed();
+
+// Logs totals and per-bucket stats of the malloc partitions.
+void DumpAllocatorStats();
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_ALLOCATOR_H_
@@ -0,0 +1,286 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/naive_cert_verifier.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/json/json_reader.h"
+#include "base/json/json_writer.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/task/thread_pool.h"
+#include "base/values.h"
+#include "crypto/sha2.h"
+#include "net/base/net_errors.h"
+#include "net/cert/asn1_util.h"
+#include "net/cert/cert_verify_result.h"
+#include "net/cert/x509_certificate.h"
+#include "net/cert/x509_util.h"
+#include "third_party/boringssl/src/include/openssl/sha.h"
+
+namespace net {
+
+namespace {
+
+constexpr size_t kMaxCacheEntries = 256;
+constexpr base::TimeDelta kCacheTTL = base::Days(1);
+
+// Hashes the length of |data| before it, so that adjacent fields can't be
+// shifted into one another. DER certificates are already self-delimiting.
+void UpdateWithLength(SHA256_CTX* ctx, const std::string& data) {
+  uint64_t size = data.size();
+  SHA256_Update(ctx, &size, sizeof(size));
+  SHA256_Update(ctx, data.data(), data.size());
+}
+
+// Same fields as CertVerifier::RequestParams' private key.
+std::string ComputeKey(const CertVerifier::RequestParams& params) {
+  const X509Certificate* cert = params.certificate().get();
+  int flags = params.flags();
+  SHA256_CTX ctx;
+  SHA256_Init(&ctx);
+  SHA256_Update(&ctx, CRYPTO_BUFFER_data(cert->cert_buffer()),
+                CRYPTO_BUFFER_len(cert->cert_buffer()));
+  for (const auto& buffer : cert->intermediate_buffers()) {
+    SHA256_Update(&ctx, CRYPTO_BUFFER_data(buffer.get()),
+                  CRYPTO_BUFFER_len(buffer.get()));
+  }
+  UpdateWithLength(&ctx, params.hostname());
+  SHA256_Update(&ctx, &flags, sizeof(flags));
+  UpdateWithLength(&ctx, params.ocsp_response());
+  UpdateWithLength(&ctx, params.sct_list());
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &ctx);
+  return base::HexEncode(digest, sizeof(digest));
+}
+
+std::string TimeToString(base::Time time) {
+  return base::NumberToString(
+      time.ToDeltaSinceWindowsEpoch().InMicroseconds());
+}
+
+bool StringToTime(const std::string* input, base::Time* time) {
+  int64_t us;
+  if (!input || !base::StringToInt64(*input, &us))
+    return false;
+  *time = base::Time::FromDeltaSinceWindowsEpoch(base::Microseconds(us));
+  return true;
+}
+
+}  // namespace
+
+NaiveCertVerifier::CachedResult::CachedResult() = default;
+
+NaiveCertVerifier::CachedResult::CachedResult(const CachedResult&) = default;
+
+NaiveCertVerifier::CachedResult::~CachedResult() = default;
+
+NaiveCertVerifier::NaiveCertVerifier(std::unique_ptr<CertVerifier> verifier,
+                                     const std::string& proxy_host,
+                                     const HashValueVector& pins,
+                                     const base::FilePath& cache_path)
+    : verifier_(std::move(verifier)), proxy_host_(proxy_host), pins_(pins) {
+  if (!cache_path.empty()) {
+    writer_ = std::make_unique<base::ImportantFileWriter>(
+        cache_path,
+        base::ThreadPool::CreateSequencedTaskRunner(
+            {base::MayBlock(), base::TaskPriority::BEST_EFFORT,
+             base::TaskShutdownBehavior::BLOCK_SHUTDOWN}));
+    Load();
+  }
+  CertDatabase::GetInstance()->AddObserver(this);
+}
+
+NaiveCertVerifier::~NaiveCertVerifier() {
+  CertDatabase::GetInstance()->RemoveObserver(this);
+  if (writer_ && writer_->HasPendingWrite())
+    writer_->DoScheduledWrite();
+}
+
+int NaiveCertVerifier::Verify(const RequestParams& params,
+                              CertVerifyResult* verify_result,
+                              CompletionOnceCallback callback,
+                              std::unique_ptr<Request>* out_req,
+                              const NetLogWithSource& net_log) {
+  out_req->reset();
+
+  if (MatchesPin(params)) {
+    verify_result->Reset();
+    verify_result->verified_cert = params.certificate();
+    verify_result->public_key_hashes = pins_;
+    return OK;
+  }
+
+  if (!writer_) {
+    return verifier_->Verify(params, verify_result, std::move(callback),
+                             out_req, net_log);
+  }
+
+  std::string key = ComputeKey(params);
+  base::Time now = base::Time::Now();
+  auto it = cache_.find(key);
+  if (it != cache_.end()) {
+    const CachedResult& cached = it->second;
+    // Re-verifies if the clock went backwards, like CachingCertVerifier.
+    if (now >= cached.verification_time && now < cached.expiration_time) {
+      verify_result->Reset();
+      verify_result->verified_cert = params.certificate();
+      verify_result->cert_status = cached.cert_status;
+      verify_result->is_issued_by_known_root = cached.is_issued_by_known_root;
+      verify_result->public_key_hashes = cached.public_key_hashes;
+      return OK;
+    }
+    cache_.erase(it);
+  }
+
+  CompletionOnceCallback caching_callback = base::BindOnce(
+      &NaiveCertVerifier::OnRequestFinished, base::Unretained(this),
+      config_id_, key, params, now, std::move(callback), verify_result);
+  int result = verifier_->Verify(params, verify_result,
+                                 std::move(caching_callback), out_req, net_log);
+  if (result != ERR_IO_PENDING)
+    AddResultToCache(config_id_, key, params, now, *verify_result, result);
+  return result;
+}
+
+void NaiveCertVerifier::SetConfig(const Config& config) {
+  verifier_->SetConfig(config);
+  ++config_id_;
+  ClearCache();
+}
+
+void NaiveCertVerifier::OnCertDBChanged() {
+  ++config_id_;
+  ClearCache();
+}
+
+bool NaiveCertVerifier::SerializeData(std::string* data) {
+  base::Value entries(base::Value::Type::DICTIONARY);
+  for (const auto& [key, cached] : cache_) {
+    base::Value entry(base::Value::Type::DICTIONARY);
+    entry.SetStringKey("verified", TimeToString(cached.verification_time));
+    entry.SetStringKey("expires", TimeToString(cached.expiration_time));
+    entry.SetIntKey("status", static_cast<int>(cached.cert_status));
+    entry.SetBoolKey("known_root", cached.is_issued_by_known_root);
+    base::Value hashes(base::Value::Type::LIST);
+    for (const HashValue& hash : cached.public_key_hashes)
+      hashes.Append(hash.ToString());
+    entry.SetKey("hashes", std::move(hashes));
+    entries.SetKey(key, std::move(entry));
+  }
+  return base::JSONWriter::Write(entries, data);
+}
+
+bool NaiveCertVerifier::MatchesPin(const RequestParams& params) const {
+  if (pins_.empty() || params.hostname() != proxy_host_)
+    return false;
+  base::StringPiece spki;
+  if (!asn1::ExtractSPKIFromDERCert(
+          x509_util::CryptoBufferAsStringPiece(
+              params.certificate()->cert_buffer()),
+          &spki)) {
+    return false;
+  }
+  SHA256HashValue hash;
+  crypto::SHA256HashString(spki, hash.data, sizeof(hash.data));
+  return std::find(pins_.begin(), pins_.end(), HashValue(hash)) != pins_.end();
+}
+
+void NaiveCertVerifier::Load() {
+  std::string json;
+  if (!base::ReadFileToString(writer_->path(), &json))
+    return;
+  absl::optional<base::Value> entries = base::JSONReader::Read(json);
+  if (!entries || !entries->is_dict()) {
+    LOG(WARNING) << "Ignoring invalid cert cache " << writer_->path();
+    return;
+  }
+
+  base::Time now = base::Time::Now();
+  for (const auto kv : entries->DictItems()) {
+    const base::Value& entry = kv.second;
+    if (!entry.is_dict())
+      continue;
+    CachedResult cached;
+    absl::optional<int> status = entry.FindIntKey("status");
+    absl::optional<bool> known_root = entry.FindBoolKey("known_root");
+    const base::Value* hashes = entry.FindListKey("hashes");
+    if (!StringToTime(entry.FindStringKey("verified"),
+                      &cached.verification_time) ||
+        !StringToTime(entry.FindStringKey("expires"),
+                      &cached.expiration_time) ||
+        !status || !known_root || !hashes) {
+      continue;
+    }
+    if (now < cached.verification_time || now >= cached.expiration_time)
+      continue;
+    cached.cert_status = static_cast<CertStatus>(*status);
+    cached.is_issued_by_known_root = *known_root;
+    bool valid = true;
+    for (const base::Value& hash : hashes->GetList()) {
+      HashValue value;
+      if (!hash.is_string() || !value.FromString(hash.GetString())) {
+        valid = false;
+        break;
+      }
+      cached.public_key_hashes.push_back(value);
+    }
+    if (valid && cache_.size() < kMaxCacheEntries)
+      cache_.emplace(kv.first, std::move(cached));
+  }
+}
+
+void NaiveCertVerifier::ClearCache() {
+  if (cache_.empty())
+    return;
+  cache_.clear();
+  if (writer_)
+    writer_->ScheduleWrite(this);
+}
+
+void NaiveCertVerifier::OnRequestFinished(uint32_t config_id,
+                                          const std::string& key,
+                                          const RequestParams& params,
+                                          base::Time start_time,
+                                          CompletionOnceCallback callback,
+                                          CertVerifyResult* verify_result,
+                                          int error) {
+  AddResultToCache(config_id, key, params, start_time, *verify_result, error);
+  std::move(callback).Run(error);
+}
+
+void NaiveCertVerifier::AddResultToCache(uint32_t config_id,
+                                         const std::string& key,
+                                         const RequestParams& params,
+                                         base::Time start_time,
+                                         const CertVerifyResult& verify_result,
+                                         int error) {
+  // Failures are not persisted: a later attempt may well succeed, and the
+  // in-memory cache below already absorbs retries.
+  if (config_id != config_id_ || error != OK)
+    return;
+
+  if (cache_.size() >= kMaxCacheEntries) {
+    auto oldest = std::min_element(
+        cache_.begin(), cache_.end(), [](const auto& a, const auto& b) {
+          return a.second.verification_time < b.second.verification_time;
+        });
+    cache_.erase(oldest);
+  }
+
+  CachedResult cached;
+  cached.verification_time = start_time;
+  cached.expiration_time = std::min(start_time + kCacheTTL,
+                                    params.certificate()->valid_expiry());
+  cached.cert_status = verify_result.cert_status;
+  cached.is_issued_by_known_root = verify_result.is_issued_by_known_root;
+  cached.public_key_hashes = verify_result.public_key_hashes;
+  cache_[key] = std::move(cached);
+  writer_->ScheduleWrite(this);
+}
+
+}  // namespace net
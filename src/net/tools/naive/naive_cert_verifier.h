@@ -0,0 +1,100 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_CERT_VERIFIER_H_
+#define NET_TOOLS_NAIVE_NAIVE_CERT_VERIFIER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/important_file_writer.h"
+#include "base/time/time.h"
+#include "net/base/hash_value.h"
+#include "net/cert/cert_database.h"
+#include "net/cert/cert_status_flags.h"
+#include "net/cert/cert_verifier.h"
+
+namespace net {
+
+class CertVerifyResult;
+
+// Sits in front of the default verifier, which already coalesces identical
+// verifications and caches results in memory, and adds two ways to skip path
+// building for the proxy server:
+//
+// - If the proxy certificate's public key matches one of |pins|, the
+//   certificate is accepted without verification. This also allows
+//   self-signed proxy certificates.
+// - Successful results are kept for a day, or until the certificate expires,
+//   in |cache_path| if it is not empty, so that restarts and reconnects do not
+//   verify the same chain again.
+class NaiveCertVerifier : public CertVerifier,
+                          public CertDatabase::Observer,
+                          public base::ImportantFileWriter::DataSerializer {
+ public:
+  NaiveCertVerifier(std::unique_ptr<CertVerifier> verifier,
+                    const std::string& proxy_host,
+                    const HashValueVector& pins,
+                    const base::FilePath& cache_path);
+  NaiveCertVerifier(const NaiveCertVerifier&) = delete;
+  NaiveCertVerifier& operator=(const NaiveCertVerifier&) = delete;
+  ~NaiveCertVerifier() override;
+
+  // CertVerifier:
+  int Verify(const RequestParams& params,
+             CertVerifyResult* verify_result,
+             CompletionOnceCallback callback,
+             std::unique_ptr<Request>* out_req,
+             const NetLogWithSource& net_log) override;
+  void SetConfig(const Config& config) override;
+
+  // CertDatabase::Observer:
+  void OnCertDBChanged() override;
+
+  // base::ImportantFileWriter::DataSerializer:
+  bool SerializeData(std::string* data) override;
+
+ private:
+  struct CachedResult {
+    CachedResult();
+    CachedResult(const CachedResult&);
+    ~CachedResult();
+
+    base::Time verification_time;
+    base::Time expiration_time;
+    CertStatus cert_status = 0;
+    bool is_issued_by_known_root = false;
+    HashValueVector public_key_hashes;
+  };
+
+  bool MatchesPin(const RequestParams& params) const;
+  void Load();
+  void ClearCache();
+  void OnRequestFinished(uint32_t config_id,
+                         const std::string& key,
+                         const RequestParams& params,
+                         base::Time start_time,
+                         CompletionOnceCallback callback,
+                         CertVerifyResult* verify_result,
+                         int error);
+  void AddResultToCache(uint32_t config_id,
+                        const std::string& key,
+                        const RequestParams& params,
+                        base::Time start_time,
+                        const CertVerifyResult& verify_result,
+                        int error);
+
+  std::unique_ptr<CertVerifier> verifier_;
+  const std::string proxy_host_;
+  const HashValueVector pins_;
+
+  uint32_t config_id_ = 0;
+  // Keyed by the SHA-256 of the request parameters.
+  std::map<std::string, CachedResult> cache_;
+  std::unique_ptr<base::ImportantFileWriter> writer_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_CERT_VERIFIER_H_
@@ -0,0 +1,80 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/naive_client_socket_factory.h"
+
+#include <utility>
+
+#include "base/bind.h"
+#include "net/http/proxy_client_socket.h"
+#include "net/socket/datagram_client_socket.h"
+#include "net/socket/socket_performance_watcher.h"
+#include "net/socket/ssl_client_socket.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/socket/transport_client_socket.h"
+
+namespace net {
+
+NaiveClientSocketFactory::NaiveClientSocketFactory(
+    const SocketOptions& socket_options)
+    : socket_options_(socket_options),
+      default_factory_(ClientSocketFactory::GetDefaultFactory()) {}
+
+NaiveClientSocketFactory::~NaiveClientSocketFactory() = default;
+
+std::unique_ptr<DatagramClientSocket>
+NaiveClientSocketFactory::CreateDatagramClientSocket(
+    DatagramSocket::BindType bind_type,
+    NetLog* net_log,
+    const NetLogSource& source) {
+  return default_factory_->CreateDatagramClientSocket(bind_type, net_log,
+                                                      source);
+}
+
+std::unique_ptr<TransportClientSocket>
+NaiveClientSocketFactory::CreateTransportClientSocket(
+    const AddressList& addresses,
+    std::unique_ptr<SocketPerformanceWatcher> socket_performance_watcher,
+    NetworkQualityEstimator* network_quality_estimator,
+    NetLog* net_log,
+    const NetLogSource& source) {
+  auto socket = std::make_unique<TCPClientSocket>(
+      addresses, std::move(socket_performance_watcher),
+      network_quality_estimator, net_log, source);
+  if (socket_options_.fast_open) {
+    // The socket owns the callback, so it never outlives the socket.
+    socket->SetBeforeConnectCallback(base::BindRepeating(
+        &EnableTCPFastOpenConnect, base::Unretained(socket.get())));
+  }
+  return socket;
+}
+
+std::unique_ptr<SSLClientSocket>
+NaiveClientSocketFactory::CreateSSLClientSocket(
+    SSLClientContext* context,
+    std::unique_ptr<StreamSocket> stream_socket,
+    const HostPortPair& host_and_port,
+    const SSLConfig& ssl_config) {
+  return default_factory_->CreateSSLClientSocket(
+      context, std::move(stream_socket), host_and_port, ssl_config);
+}
+
+std::unique_ptr<ProxyClientSocket>
+NaiveClientSocketFactory::CreateProxyClientSocket(
+    std::unique_ptr<StreamSocket> stream_socket,
+    const std::string& user_agent,
+    const HostPortPair& endpoint,
+    const ProxyServer& proxy_server,
+    HttpAuthController* http_auth_controller,
+    bool tunnel,
+    bool using_spdy,
+    NextProto negotiated_protocol,
+    ProxyDelegate* proxy_delegate,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  return default_factory_->CreateProxyClientSocket(
+      std::move(stream_socket), user_agent, endpoint, proxy_server,
+      http_auth_controller, tunnel, using_spdy, negotiated_protocol,
+      proxy_delegate, traffic_annotation);
+}
+
+}  // namespace net
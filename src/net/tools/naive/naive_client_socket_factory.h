@@ -0,0 +1,59 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_CLIENT_SOCKET_FACTORY_H_
+#define NET_TOOLS_NAIVE_NAIVE_CLIENT_SOCKET_FACTORY_H_
+
+#include <memory>
+#include <string>
+
+#include "base/macros.h"
+#include "net/socket/client_socket_factory.h"
+#include "net/tools/naive/naive_socket_options.h"
+
+namespace net {
+
+// Forwards to the default factory, and tunes outbound TCP connections
+// according to |socket_options|. The caller only sets |fast_open| when all
+// outbound TCP connections go to the proxy server.
+class NaiveClientSocketFactory : public ClientSocketFactory {
+ public:
+  explicit NaiveClientSocketFactory(const SocketOptions& socket_options);
+  ~NaiveClientSocketFactory() override;
+
+  std::unique_ptr<DatagramClientSocket> CreateDatagramClientSocket(
+      DatagramSocket::BindType bind_type,
+      NetLog* net_log,
+      const NetLogSource& source) override;
+  std::unique_ptr<TransportClientSocket> CreateTransportClientSocket(
+      const AddressList& addresses,
+      std::unique_ptr<SocketPerformanceWatcher> socket_performance_watcher,
+      NetworkQualityEstimator* network_quality_estimator,
+      NetLog* net_log,
+      const NetLogSource& source) override;
+  std::unique_ptr<SSLClientSocket> CreateSSLClientSocket(
+      SSLClientContext* context,
+      std::unique_ptr<StreamSocket> stream_socket,
+      const HostPortPair& host_and_port,
+      const SSLConfig& ssl_config) override;
+  std::unique_ptr<ProxyClientSocket> CreateProxyClientSocket(
+      std::unique_ptr<StreamSocket> stream_socket,
+      const std::string& user_agent,
+      const HostPortPair& endpoint,
+      const ProxyServer& proxy_server,
+      HttpAuthController* http_auth_controller,
+      bool tunnel,
+      bool using_spdy,
+      NextProto negotiated_protocol,
+      ProxyDelegate* proxy_delegate,
+      const NetworkTrafficAnnotationTag& traffic_annotation) override;
+
+ private:
+  SocketOptions socket_options_;
+  ClientSocketFactory* default_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(NaiveClientSocketFactory);
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_CLIENT_SOCKET_FACTORY_H_
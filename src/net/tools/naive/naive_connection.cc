@@ -7,10 +7,12 @@
 
 #include <cstring>
 #include <utility>
+#include <vector>
 
 #include "base/bind.h"
 #include "base/callback_helpers.h"
 #include "base/logging.h"
+#include "base/no_destructor.h"
 #include "base/rand_util.h"
 #include "base/strings/strcat.h"
 #include "base/threading/thread_task_runner_handle.h"
@@ -23,8 +25,10 @@
 #include "net/socket/client_socket_handle.h"
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/stream_socket.h"
+#include "net/socket/tcp_client_socket.h"
 #include "net/spdy/spdy_session.h"
 #include "net/tools/naive/http_proxy_socket.h"
+#include "net/tools/naive/naive_flight_recorder.h"
 #include "net/tools/naive/redirect_resolver.h"
 #include "net/tools/naive/socks5_server_socket.h"
 
@@ -35,7 +39,6 @@
 
 #include "net/base/ip_endpoint.h"
 #include "net/base/sockaddr_storage.h"
-#include "net/socket/tcp_client_socket.h"
 #endif
 
 namespace net {
@@ -45,6 +48,30 @@ constexpr int kBufferSize = 64 * 1024;
 constexpr int kFirstPaddings = 8;
 constexpr int kPaddingHeaderSize = 3;
 constexpr int kMaxPaddingSize = 255;
+constexpr size_t kMaxPooledBuffers = 16;
+
+// Read buffers not taken by a pending read, shared by all connections on the
+// network thread. Pulls only take a buffer once data is ready, so idle
+// connections hold none.
+std::vector<scoped_refptr<IOBuffer>>& GetReadBufferPool() {
+  static base::NoDestructor<std::vector<scoped_refptr<IOBuffer>>> pool;
+  return *pool;
+}
+
+scoped_refptr<IOBuffer> TakeReadBuffer() {
+  auto& pool = GetReadBufferPool();
+  if (pool.empty())
+    return base::MakeRefCounted<IOBuffer>(kBufferSize);
+  scoped_refptr<IOBuffer> buffer = std::move(pool.back());
+  pool.pop_back();
+  return buffer;
+}
+
+void ReleaseReadBuffer(scoped_refptr<IOBuffer> buffer) {
+  auto& pool = GetReadBufferPool();
+  if (buffer->HasOneRef() && pool.size() < kMaxPooledBuffers)
+    pool.push_back(std::move(buffer));
+}
 }  // namespace
 
 NaiveConnection::NaiveConnection(
@@ -55,6 +82,7 @@ NaiveConnection::NaiveConnection(
     const SSLConfig& server_ssl_config,
     const SSLConfig& proxy_ssl_config,
     RedirectResolver* resolver,
+    const SocketOptions& socket_options,
     HttpNetworkSession* session,
     const NetworkIsolationKey& network_isolation_key,
     const NetLogWithSource& net_log,
@@ -67,6 +95,7 @@ NaiveConnection::NaiveConnection(
       server_ssl_config_(server_ssl_config),
       proxy_ssl_config_(proxy_ssl_config),
       resolver_(resolver),
+      socket_options_(socket_options),
       session_(session),
       network_isolation_key_(network_isolation_key),
       net_log_(net_log),
@@ -76,6 +105,8 @@ NaiveConnection::NaiveConnection(
       sockets_{client_socket_.get(), nullptr},
       errors_{OK, OK},
       write_pending_{false, false},
+      first_byte_seen_{false, false},
+      read_if_ready_{true, true},
       early_pull_pending_(false),
       can_push_to_server_(false),
       early_pull_result_(ERR_IO_PENDING),
@@ -222,6 +253,11 @@ int NaiveConnection::DoConnectServer() {
     SockaddrStorage dst;
     int rv;
     rv = getsockopt(sd, SOL_IP, SO_ORIGINAL_DST, dst.addr, &dst.addr_len);
+    if (rv != 0) {
+      // IP6T_SO_ORIGINAL_DST has the same value.
+      dst = SockaddrStorage();
+      rv = getsockopt(sd, SOL_IPV6, SO_ORIGINAL_DST, dst.addr, &dst.addr_len);
+    }
     if (rv == 0) {
       IPEndPoint ipe;
       if (ipe.FromSockAddr(dst.addr, dst.addr_len)) {
@@ -249,6 +285,7 @@ int NaiveConnection::DoConnectServer() {
   }
 
   LOG(INFO) << "Connection " << id_ << " to " << origin.ToString();
+  FlightRecorder::Get()->Record(id_, FlightEvent::kOriginResolved);
 
   // Ignores socket limit set by socket pool for this type of socket.
   return InitSocketHandleForRawConnect2(
@@ -259,12 +296,21 @@ int NaiveConnection::DoConnectServer() {
 }
 
 int NaiveConnection::DoConnectServerComplete(int result) {
+  FlightRecorder::Get()->Record(id_, FlightEvent::kTunnelOpened, result);
   if (result < 0)
     return result;
 
   DCHECK(server_socket_handle_->socket());
   sockets_[kServer] = server_socket_handle_->socket();
 
+  // Direct connections are plain TCPClientSocket. Proxied connections are
+  // tunnel streams whose transport is shared and not tuned here.
+  if (proxy_info_.is_direct()) {
+    ApplySocketOptions(
+        static_cast<TCPClientSocket*>(server_socket_handle_->socket()),
+        socket_options_);
+  }
+
   full_duplex_ = true;
   next_state_ = STATE_NONE;
   return OK;
@@ -309,6 +355,7 @@ void NaiveConnection::Pull(Direction from, Direction to) {
     return;
 
   int read_size = kBufferSize;
+  bool padded = false;
   auto padding_direction = padding_detector_delegate_->GetPaddingDirection();
   if (from == padding_direction && num_paddings_[from] < kFirstPaddings) {
     auto buffer = base::MakeRefCounted<GrowableIOBuffer>();
@@ -316,15 +363,34 @@ void NaiveConnection::Pull(Direction from, Direction to) {
     buffer->set_offset(kPaddingHeaderSize);
     read_buffers_[from] = buffer;
     read_size = kBufferSize - kPaddingHeaderSize - kMaxPaddingSize;
+    padded = true;
   } else {
-    read_buffers_[from] = base::MakeRefCounted<IOBuffer>(kBufferSize);
+    read_buffers_[from] = TakeReadBuffer();
   }
 
   DCHECK(sockets_[from]);
-  int rv = sockets_[from]->Read(
-      read_buffers_[from].get(), read_size,
-      base::BindRepeating(&NaiveConnection::OnPullComplete,
-                          weak_ptr_factory_.GetWeakPtr(), from, to));
+  int rv = ERR_READ_IF_READY_NOT_IMPLEMENTED;
+  if (read_if_ready_[from]) {
+    rv = sockets_[from]->ReadIfReady(
+        read_buffers_[from].get(), read_size,
+        base::BindOnce(&NaiveConnection::OnPullReady,
+                       weak_ptr_factory_.GetWeakPtr(), from, to));
+    if (rv == ERR_READ_IF_READY_NOT_IMPLEMENTED)
+      read_if_ready_[from] = false;
+  }
+  if (!read_if_ready_[from]) {
+    rv = sockets_[from]->Read(
+        read_buffers_[from].get(), read_size,
+        base::BindRepeating(&NaiveConnection::OnPullComplete,
+                            weak_ptr_factory_.GetWeakPtr(), from, to));
+  } else if (rv == ERR_IO_PENDING) {
+    // The socket does not keep the buffer while waiting for data.
+    if (padded) {
+      read_buffers_[from] = nullptr;
+    } else {
+      ReleaseReadBuffer(std::move(read_buffers_[from]));
+    }
+  }
 
   if (from == kClient && early_pull_pending_)
     early_pull_result_ = rv;
@@ -333,13 +399,24 @@ void NaiveConnection::Pull(Direction from, Direction to) {
     OnPullComplete(from, to, rv);
 }
 
+void NaiveConnection::OnPullReady(Direction from, Direction to, int result) {
+  if (result < 0) {
+    OnPullComplete(from, to, result);
+    return;
+  }
+  Pull(from, to);
+}
+
 void NaiveConnection::Push(Direction from, Direction to, int size) {
   int write_size = size;
   int write_offset = 0;
+  // Padded reads use a GrowableIOBuffer, which does not go back to the pool.
+  bool pooled = true;
   auto padding_direction = padding_detector_delegate_->GetPaddingDirection();
   if (from == padding_direction && num_paddings_[from] < kFirstPaddings) {
     // Adds padding.
-    ++num_paddings_[from];
+    pooled = false;
+    CountPadding(from);
     int padding_size = base::RandInt(0, kMaxPaddingSize);
     auto* buffer = static_cast<GrowableIOBuffer*>(read_buffers_[from].get());
     buffer->set_offset(0);
@@ -361,7 +438,7 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
       if (size == kPaddingHeaderSize + payload_size + padding_size) {
         write_size = payload_size;
         write_offset = kPaddingHeaderSize;
-        ++num_paddings_[from];
+        CountPadding(from);
         trivial_padding = true;
       }
     }
@@ -409,7 +486,7 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
             if (padding_length_ <= size - i) {
               copy_size = padding_length_;
               read_padding_state_ = STATE_READ_PAYLOAD_LENGTH_1;
-              ++num_paddings_[from];
+              CountPadding(from);
             } else {
               copy_size = size - i;
             }
@@ -428,7 +505,10 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
   }
 
   write_buffers_[to] = base::MakeRefCounted<DrainableIOBuffer>(
-      std::move(read_buffers_[from]), write_offset + write_size);
+      read_buffers_[from], write_offset + write_size);
+  if (pooled)
+    pushed_buffers_[to] = read_buffers_[from];
+  read_buffers_[from] = nullptr;
   if (write_offset) {
     write_buffers_[to]->DidConsume(write_offset);
   }
@@ -444,6 +524,11 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
     OnPushComplete(from, to, rv);
 }
 
+void NaiveConnection::CountPadding(Direction from) {
+  if (++num_paddings_[from] == kFirstPaddings)
+    FlightRecorder::Get()->Record(id_, FlightEvent::kPaddingEnd, from);
+}
+
 void NaiveConnection::Disconnect(Direction side) {
   if (sockets_[side]) {
     sockets_[side]->Disconnect();
@@ -507,6 +592,11 @@ void NaiveConnection::OnPullComplete(Direction from, Direction to, int result) {
     return;
   }
 
+  if (!first_byte_seen_[from]) {
+    first_byte_seen_[from] = true;
+    FlightRecorder::Get()->Record(id_, FlightEvent::kFirstByte, from);
+  }
+
   if (from == kClient && !can_push_to_server_)
     return;
 
@@ -530,6 +620,13 @@ void NaiveConnection::OnPushComplete(Direction from, Direction to, int result) {
     }
   }
 
+  // Returns the buffer to the pool once the write has drained, so idle
+  // directions hold none. It stays out of the pool while the socket still
+  // references it, e.g. QUIC until the data is acknowledged.
+  write_buffers_[to] = nullptr;
+  if (pushed_buffers_[to])
+    ReleaseReadBuffer(std::move(pushed_buffers_[to]));
+
   write_pending_[to] = false;
   // Checks for termination even if result is OK.
   OnPushError(from, to, result >= 0 ? OK : result);
@@ -17,6 +17,7 @@
 #include "net/base/completion_repeating_callback.h"
 #include "net/tools/naive/naive_protocol.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
+#include "net/tools/naive/naive_socket_options.h"
 
 namespace net {
 
@@ -44,6 +45,7 @@ class NaiveConnection {
       const SSLConfig& server_ssl_config,
       const SSLConfig& proxy_ssl_config,
       RedirectResolver* resolver,
+      const SocketOptions& socket_options,
       HttpNetworkSession* session,
       const NetworkIsolationKey& network_isolation_key,
       const NetLogWithSource& net_log,
@@ -87,8 +89,11 @@ class NaiveConnection {
   void OnBothDisconnected();
   void OnPullError(Direction from, Direction to, int error);
   void OnPushError(Direction from, Direction to, int error);
+  // Called when a pending ReadIfReady() has data to read.
+  void OnPullReady(Direction from, Direction to, int result);
   void OnPullComplete(Direction from, Direction to, int result);
   void OnPushComplete(Direction from, Direction to, int result);
+  void CountPadding(Direction from);
 
   unsigned int id_;
   ClientProtocol protocol_;
@@ -97,6 +102,7 @@ class NaiveConnection {
   const SSLConfig& server_ssl_config_;
   const SSLConfig& proxy_ssl_config_;
   RedirectResolver* resolver_;
+  const SocketOptions& socket_options_;
   HttpNetworkSession* session_;
   const NetworkIsolationKey& network_isolation_key_;
   const NetLogWithSource& net_log_;
@@ -113,8 +119,13 @@ class NaiveConnection {
   StreamSocket* sockets_[kNumDirections];
   scoped_refptr<IOBuffer> read_buffers_[kNumDirections];
   scoped_refptr<DrainableIOBuffer> write_buffers_[kNumDirections];
+  // The pooled read buffer behind |write_buffers_|, if any.
+  scoped_refptr<IOBuffer> pushed_buffers_[kNumDirections];
   int errors_[kNumDirections];
   bool write_pending_[kNumDirections];
+  bool first_byte_seen_[kNumDirections];
+  // False once the socket is found not to support ReadIfReady().
+  bool read_if_ready_[kNumDirections];
   int bytes_passed_without_yielding_[kNumDirections];
   base::TimeTicks yield_after_time_[kNumDirections];
 
@@ -0,0 +1,121 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/naive_flight_recorder.h"
+
+#include <string>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/no_destructor.h"
+#include "base/strings/stringprintf.h"
+#include "base/task/thread_pool.h"
+#include "base/time/time.h"
+#include "net/base/net_errors.h"
+#include "net/tools/naive/naive_protocol.h"
+
+namespace net {
+
+namespace {
+
+constexpr base::TimeDelta kDumpWindow = base::Minutes(1);
+
+const char* ProtocolToString(int protocol) {
+  switch (static_cast<ClientProtocol>(protocol)) {
+    case ClientProtocol::kSocks5:
+      return "socks";
+    case ClientProtocol::kHttp:
+      return "http";
+    case ClientProtocol::kRedir:
+      return "redir";
+  }
+  return "unknown";
+}
+
+const char* DirectionToString(int direction) {
+  return direction == kClient ? "client" : "server";
+}
+
+void WriteDump(const base::FilePath& path, const std::string& data) {
+  if (!base::WriteFile(path, data)) {
+    LOG(ERROR) << "Failed to write flight recorder dump to " << path;
+    return;
+  }
+  LOG(INFO) << "Flight recorder dumped to " << path;
+}
+
+}  // namespace
+
+// static
+FlightRecorder* FlightRecorder::Get() {
+  static base::NoDestructor<FlightRecorder> instance;
+  return instance.get();
+}
+
+FlightRecorder::FlightRecorder() : entries_(new Entry[kCapacity]) {}
+
+FlightRecorder::~FlightRecorder() = default;
+
+void FlightRecorder::Record(unsigned int connection_id,
+                            FlightEvent event,
+                            int value) {
+  Entry& entry = entries_[next_];
+  entry.time_us = base::TimeTicks::Now().since_origin().InMicroseconds();
+  entry.connection_id = connection_id;
+  entry.value = static_cast<int16_t>(value);
+  entry.event = event;
+  if (++next_ == kCapacity) {
+    next_ = 0;
+    wrapped_ = true;
+  }
+}
+
+void FlightRecorder::Dump(const base::FilePath& path) const {
+  const int64_t now_us = base::TimeTicks::Now().since_origin().InMicroseconds();
+  const int64_t start_us = now_us - kDumpWindow.InMicroseconds();
+
+  std::string data;
+  size_t count = wrapped_ ? kCapacity : next_;
+  size_t begin = wrapped_ ? next_ : 0;
+  for (size_t i = 0; i < count; ++i) {
+    const Entry& entry = entries_[(begin + i) % kCapacity];
+    if (entry.time_us < start_us)
+      continue;
+
+    std::string detail;
+    switch (entry.event) {
+      case FlightEvent::kAccepted:
+        detail = std::string("accepted ") + ProtocolToString(entry.value);
+        break;
+      case FlightEvent::kOriginResolved:
+        detail = "origin resolved";
+        break;
+      case FlightEvent::kTunnelOpened:
+        detail = "tunnel opened " + ErrorToShortString(entry.value);
+        break;
+      case FlightEvent::kFirstByte:
+        detail = std::string("first byte from ") +
+                 DirectionToString(entry.value);
+        break;
+      case FlightEvent::kPaddingEnd:
+        detail = std::string("padding end from ") +
+                 DirectionToString(entry.value);
+        break;
+      case FlightEvent::kClosed:
+        detail = "closed " + ErrorToShortString(entry.value);
+        break;
+    }
+    base::StringAppendF(&data, "%.3f connection %u %s\n",
+                        (entry.time_us - now_us) / 1e6, entry.connection_id,
+                        detail.c_str());
+  }
+
+  base::ThreadPool::PostTask(
+      FROM_HERE, {base::MayBlock(), base::TaskPriority::USER_VISIBLE},
+      base::BindOnce(&WriteDump, path, std::move(data)));
+}
+
+}  // namespace net
@@ -0,0 +1,66 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_FLIGHT_RECORDER_H_
+#define NET_TOOLS_NAIVE_NAIVE_FLIGHT_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "base/files/file_path.h"
+
+namespace net {
+
+enum class FlightEvent : uint8_t {
+  // Value is the ClientProtocol.
+  kAccepted,
+  // The client handshake finished and the origin is known.
+  kOriginResolved,
+  // Value is the result of connecting to the origin or opening the tunnel.
+  kTunnelOpened,
+  // Value is the Direction the byte came from.
+  kFirstByte,
+  // Value is the Direction whose first paddings are done.
+  kPaddingEnd,
+  // Value is the close reason.
+  kClosed,
+};
+
+// Keeps the most recent connection lifecycle events in a fixed ring so that a
+// misbehaving connection can be investigated after the fact without turning on
+// logging. Recording is a clock read and a 16-byte store. Only used on the
+// network thread.
+class FlightRecorder {
+ public:
+  static FlightRecorder* Get();
+
+  FlightRecorder();
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+  ~FlightRecorder();
+
+  void Record(unsigned int connection_id, FlightEvent event, int value = 0);
+
+  // Writes events from the last minute to |path| as text, in the background.
+  void Dump(const base::FilePath& path) const;
+
+ private:
+  struct Entry {
+    int64_t time_us;
+    uint32_t connection_id;
+    int16_t value;
+    FlightEvent event;
+  };
+
+  // 1 MiB.
+  static constexpr size_t kCapacity = 64 * 1024;
+
+  std::unique_ptr<Entry[]> entries_;
+  size_t next_ = 0;
+  bool wrapped_ = false;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_FLIGHT_RECORDER_H_
@@ -0,0 +1,289 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/naive_net_log_observer.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <utility>
+
+#include "base/bind.h"
+#include "base/callback_helpers.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/json/json_writer.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/task/sequenced_task_runner.h"
+#include "base/task/thread_pool.h"
+#include "base/values.h"
+#include "net/log/net_log_entry.h"
+
+// Record layout. Integers are LEB128 varints, and signed ones are zigzag
+// encoded first. Times are in microseconds since the TimeTicks origin.
+//
+//   time delta from the previous record (signed)
+//   event type
+//   event phase
+//   source type
+//   source id
+//   source start time minus event time (signed)
+//   params (value)
+//
+// A value is a one-byte tag followed by its payload:
+//
+//   0 none, 1 false, 2 true
+//   3 integer (signed varint)
+//   4 double (8 bytes, little endian)
+//   5 string (varint size, bytes)
+//   6 binary (varint size, bytes)
+//   7 dictionary (varint count, then count times string key and value)
+//   8 list (varint count, then count values)
+
+namespace net {
+
+namespace {
+
+constexpr char kMagic[] = "NAIVENL1";
+
+// Chunks are handed to the writer when they reach this size, or when they
+// hold records older than kMaxChunkAge. A timer also flushes every
+// kMaxChunkAge.
+constexpr size_t kChunkSize = 64 * 1024;
+constexpr base::TimeDelta kMaxChunkAge = base::Seconds(1);
+
+enum ValueTag : uint8_t {
+  kNone = 0,
+  kFalse = 1,
+  kTrue = 2,
+  kInteger = 3,
+  kDouble = 4,
+  kString = 5,
+  kBinary = 6,
+  kDictionary = 7,
+  kList = 8,
+};
+
+void AppendVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendSignedVarint(int64_t value, std::string* out) {
+  AppendVarint((static_cast<uint64_t>(value) << 1) ^
+                   static_cast<uint64_t>(value >> 63),
+               out);
+}
+
+void AppendBytes(const char* data, size_t size, std::string* out) {
+  AppendVarint(size, out);
+  out->append(data, size);
+}
+
+void AppendValue(const base::Value& value, std::string* out) {
+  switch (value.type()) {
+    case base::Value::Type::NONE:
+      out->push_back(kNone);
+      break;
+    case base::Value::Type::BOOLEAN:
+      out->push_back(value.GetBool() ? kTrue : kFalse);
+      break;
+    case base::Value::Type::INTEGER:
+      out->push_back(kInteger);
+      AppendSignedVarint(value.GetInt(), out);
+      break;
+    case base::Value::Type::DOUBLE: {
+      out->push_back(kDouble);
+      double d = value.GetDouble();
+      char bytes[sizeof(d)];
+      memcpy(bytes, &d, sizeof(d));
+      out->append(bytes, sizeof(bytes));
+      break;
+    }
+    case base::Value::Type::STRING: {
+      const std::string& s = value.GetString();
+      out->push_back(kString);
+      AppendBytes(s.data(), s.size(), out);
+      break;
+    }
+    case base::Value::Type::BINARY: {
+      const auto& blob = value.GetBlob();
+      out->push_back(kBinary);
+      AppendBytes(reinterpret_cast<const char*>(blob.data()), blob.size(),
+                  out);
+      break;
+    }
+    case base::Value::Type::DICTIONARY:
+      out->push_back(kDictionary);
+      AppendVarint(value.DictSize(), out);
+      for (const auto kv : value.DictItems()) {
+        AppendBytes(kv.first.data(), kv.first.size(), out);
+        AppendValue(kv.second, out);
+      }
+      break;
+    case base::Value::Type::LIST: {
+      base::Value::ConstListView list = value.GetList();
+      out->push_back(kList);
+      AppendVarint(list.size(), out);
+      for (const base::Value& item : list)
+        AppendValue(item, out);
+      break;
+    }
+  }
+}
+
+int64_t ToMicroseconds(base::TimeTicks time) {
+  return time.since_origin().InMicroseconds();
+}
+
+}  // namespace
+
+class BinaryNetLogObserver::FileWriter {
+ public:
+  explicit FileWriter(const base::FilePath& path) : path_(path) {}
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  void Initialize(std::unique_ptr<base::Value> constants) {
+    file_.Initialize(path_,
+                     base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+    if (!file_.IsValid()) {
+      LOG(ERROR) << "Failed to open " << path_ << ": "
+                 << base::File::ErrorToString(file_.error_details());
+      return;
+    }
+
+    std::string json;
+    if (constants) {
+      base::JSONWriter::WriteWithOptions(
+          *constants,
+          base::JSONWriter::OPTIONS_OMIT_DOUBLE_TYPE_PRESERVATION |
+              base::JSONWriter::OPTIONS_OMIT_BINARY_VALUES,
+          &json);
+    }
+    std::string header(kMagic, sizeof(kMagic) - 1);
+    AppendBytes(json.data(), json.size(), &header);
+    Write(header);
+  }
+
+  void Write(const std::string& data) {
+    if (!file_.IsValid())
+      return;
+    if (file_.WriteAtCurrentPos(data.data(), data.size()) !=
+        static_cast<int>(data.size())) {
+      LOG(ERROR) << "Failed to write " << path_;
+      file_.Close();
+    }
+  }
+
+ private:
+  const base::FilePath path_;
+  base::File file_;
+};
+
+// static
+std::unique_ptr<BinaryNetLogObserver> BinaryNetLogObserver::Create(
+    const base::FilePath& path,
+    std::unique_ptr<base::Value> constants) {
+  // Blocks shutdown so that the last chunk is written.
+  auto task_runner = base::ThreadPool::CreateSequencedTaskRunner(
+      {base::MayBlock(), base::TaskPriority::USER_VISIBLE,
+       base::TaskShutdownBehavior::BLOCK_SHUTDOWN});
+  auto file_writer = std::make_unique<FileWriter>(path);
+  task_runner->PostTask(
+      FROM_HERE,
+      base::BindOnce(&FileWriter::Initialize,
+                     base::Unretained(file_writer.get()),
+                     std::move(constants)));
+  return base::WrapUnique(
+      new BinaryNetLogObserver(std::move(task_runner), std::move(file_writer)));
+}
+
+BinaryNetLogObserver::BinaryNetLogObserver(
+    scoped_refptr<base::SequencedTaskRunner> task_runner,
+    std::unique_ptr<FileWriter> file_writer)
+    : task_runner_(std::move(task_runner)),
+      file_writer_(std::move(file_writer)) {}
+
+BinaryNetLogObserver::~BinaryNetLogObserver() {
+  if (net_log()) {
+    // StopObserving was not called.
+    net_log()->RemoveObserver(this);
+  }
+  {
+    base::AutoLock lock(lock_);
+    FlushChunk();
+  }
+  task_runner_->DeleteSoon(FROM_HERE, file_writer_.release());
+}
+
+void BinaryNetLogObserver::StartObserving(NetLog* net_log,
+                                          NetLogCaptureMode capture_mode) {
+  net_log->AddObserver(this, capture_mode);
+  flush_timer_.Start(FROM_HERE, kMaxChunkAge, this,
+                     &BinaryNetLogObserver::OnFlushTimer);
+}
+
+void BinaryNetLogObserver::StopObserving() {
+  flush_timer_.Stop();
+  net_log()->RemoveObserver(this);
+  base::AutoLock lock(lock_);
+  FlushChunk();
+}
+
+void BinaryNetLogObserver::Flush(base::OnceClosure callback) {
+  {
+    base::AutoLock lock(lock_);
+    FlushChunk();
+  }
+  // The writer runs tasks in order, so the reply follows the last write.
+  task_runner_->PostTaskAndReply(FROM_HERE, base::DoNothing(),
+                                 std::move(callback));
+}
+
+void BinaryNetLogObserver::OnAddEntry(const NetLogEntry& entry) {
+  base::AutoLock lock(lock_);
+  if (chunk_.empty()) {
+    chunk_.reserve(kChunkSize + kChunkSize / 4);
+    chunk_start_time_ = entry.time;
+  }
+
+  AppendSignedVarint(ToMicroseconds(entry.time) - ToMicroseconds(last_time_),
+                     &chunk_);
+  last_time_ = entry.time;
+  AppendVarint(static_cast<uint32_t>(entry.type), &chunk_);
+  AppendVarint(static_cast<uint32_t>(entry.phase), &chunk_);
+  AppendVarint(static_cast<uint32_t>(entry.source.type), &chunk_);
+  AppendVarint(entry.source.id, &chunk_);
+  AppendSignedVarint(
+      ToMicroseconds(entry.source.start_time) - ToMicroseconds(entry.time),
+      &chunk_);
+  AppendValue(entry.params, &chunk_);
+
+  if (chunk_.size() >= kChunkSize ||
+      entry.time - chunk_start_time_ >= kMaxChunkAge) {
+    FlushChunk();
+  }
+}
+
+void BinaryNetLogObserver::OnFlushTimer() {
+  base::AutoLock lock(lock_);
+  FlushChunk();
+}
+
+void BinaryNetLogObserver::FlushChunk() {
+  if (chunk_.empty())
+    return;
+  task_runner_->PostTask(FROM_HERE,
+                         base::BindOnce(&FileWriter::Write,
+                                        base::Unretained(file_writer_.get()),
+                                        std::move(chunk_)));
+  chunk_.clear();
+}
+
+}  // namespace net
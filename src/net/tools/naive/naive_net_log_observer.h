@@ -0,0 +1,84 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_NET_LOG_OBSERVER_H_
+#define NET_TOOLS_NAIVE_NAIVE_NET_LOG_OBSERVER_H_
+
+#include <memory>
+#include <string>
+
+#include "base/callback.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/log/net_log.h"
+
+namespace base {
+class FilePath;
+class SequencedTaskRunner;
+class Value;
+}  // namespace base
+
+namespace net {
+
+// Writes NetLog entries to a file in a compact binary format, for capturing
+// NetLogs in production. Compared to FileNetLogObserver, which builds a
+// base::Value and a JSON string for every entry on the calling thread, this
+// appends varint-encoded records to an in-memory chunk and hands full chunks
+// to a background sequence for writing. tools/convert-net-log.py converts the
+// output to the usual JSON format.
+//
+// File layout: the 8-byte magic "NAIVENL1", a length-prefixed JSON blob of
+// constants, then records until EOF. See naive_net_log_observer.cc.
+class BinaryNetLogObserver : public NetLog::ThreadSafeObserver {
+ public:
+  static std::unique_ptr<BinaryNetLogObserver> Create(
+      const base::FilePath& path,
+      std::unique_ptr<base::Value> constants);
+
+  BinaryNetLogObserver(const BinaryNetLogObserver&) = delete;
+  BinaryNetLogObserver& operator=(const BinaryNetLogObserver&) = delete;
+
+  // Flushes buffered records. Must not be observing.
+  ~BinaryNetLogObserver() override;
+
+  // Must be called on a sequence, which also runs the periodic flush.
+  void StartObserving(NetLog* net_log, NetLogCaptureMode capture_mode);
+  void StopObserving();
+
+  // Hands buffered records to the writer and runs |callback| once they are
+  // written, e.g. before terminating on a signal.
+  void Flush(base::OnceClosure callback);
+
+  // NetLog::ThreadSafeObserver:
+  void OnAddEntry(const NetLogEntry& entry) override;
+
+ private:
+  class FileWriter;
+
+  BinaryNetLogObserver(scoped_refptr<base::SequencedTaskRunner> task_runner,
+                       std::unique_ptr<FileWriter> file_writer);
+
+  void FlushChunk() EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void OnFlushTimer();
+
+  // OnAddEntry() is called on any thread, and the timer flushes on the
+  // observing sequence.
+  base::Lock lock_;
+  std::string chunk_ GUARDED_BY(lock_);
+  base::TimeTicks chunk_start_time_ GUARDED_BY(lock_);
+  base::TimeTicks last_time_ GUARDED_BY(lock_);
+
+  // Flushes chunks that are not filled quickly, so that records reach the
+  // file within about a second even when the process is idle.
+  base::RepeatingTimer flush_timer_;
+
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  // Deleted on |task_runner_|.
+  std::unique_ptr<FileWriter> file_writer_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_NET_LOG_OBSERVER_H_
@@ -17,33 +17,50 @@
 #include "net/proxy_resolution/configured_proxy_resolution_service.h"
 #include "net/proxy_resolution/proxy_config.h"
 #include "net/proxy_resolution/proxy_list.h"
+#include "net/quic/quic_chromium_client_session.h"
+#include "net/quic/quic_stream_factory.h"
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/server_socket.h"
 #include "net/socket/stream_socket.h"
+#include "net/socket/tcp_client_socket.h"
 #include "net/tools/naive/http_proxy_socket.h"
+#include "net/tools/naive/naive_allocator.h"
+#include "net/tools/naive/naive_flight_recorder.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
 #include "net/tools/naive/socks5_server_socket.h"
 
 namespace net {
 
-NaiveProxy::NaiveProxy(std::unique_ptr<ServerSocket> listen_socket,
-                       ClientProtocol protocol,
-                       const std::string& listen_user,
-                       const std::string& listen_pass,
-                       int concurrency,
-                       RedirectResolver* resolver,
-                       HttpNetworkSession* session,
-                       const NetworkTrafficAnnotationTag& traffic_annotation)
+namespace {
+// Shared by all listeners, so that connection ids are unique in the process,
+// e.g. in flight recorder dumps.
+unsigned int g_last_connection_id = 0;
+}  // namespace
+
+NaiveProxy::NaiveProxy(
+    std::unique_ptr<ServerSocket> listen_socket,
+    ClientProtocol protocol,
+    const std::string& listen_user,
+    const std::string& listen_pass,
+    const std::vector<NetworkIsolationKey>& network_isolation_keys,
+    bool balance_quic_sessions,
+    RedirectResolver* resolver,
+    const SocketOptions& socket_options,
+    HttpNetworkSession* session,
+    const NetworkTrafficAnnotationTag& traffic_annotation)
     : listen_socket_(std::move(listen_socket)),
       protocol_(protocol),
       listen_user_(listen_user),
       listen_pass_(listen_pass),
-      concurrency_(concurrency),
       resolver_(resolver),
+      socket_options_(socket_options),
       session_(session),
       net_log_(
           NetLogWithSource::Make(session->net_log(), NetLogSourceType::NONE)),
       last_id_(0),
+      network_isolation_keys_(network_isolation_keys),
+      balance_quic_sessions_(balance_quic_sessions),
+      tunnels_by_key_(network_isolation_keys.size()),
       traffic_annotation_(traffic_annotation) {
   const auto& proxy_config = static_cast<ConfiguredProxyResolutionService*>(
                                  session_->proxy_resolution_service())
@@ -59,9 +76,7 @@ NaiveProxy::NaiveProxy(std::unique_ptr<ServerSocket> listen_socket,
   session_->GetSSLConfig(&server_ssl_config_, &proxy_ssl_config_);
   proxy_ssl_config_.disable_cert_verification_network_fetches = true;
 
-  for (int i = 0; i < concurrency_; i++) {
-    network_isolation_keys_.push_back(NetworkIsolationKey::CreateTransient());
-  }
+  DCHECK(!network_isolation_keys_.empty());
 
   DCHECK(listen_socket_);
   // Start accepting connections in next run loop in case when delegate is not
@@ -109,6 +124,10 @@ void NaiveProxy::DoConnect() {
   auto padding_detector_delegate = std::make_unique<PaddingDetectorDelegate>(
       proxy_delegate, proxy_server, protocol_);
 
+  // Accepted sockets from TCPServerSocket are always TCPClientSocket.
+  ApplySocketOptions(static_cast<TCPClientSocket*>(accepted_socket_.get()),
+                     socket_options_);
+
   if (protocol_ == ClientProtocol::kSocks5) {
     socket = std::make_unique<Socks5ServerSocket>(std::move(accepted_socket_),
                                                   listen_user_, listen_pass_,
@@ -123,14 +142,22 @@ void NaiveProxy::DoConnect() {
     return;
   }
 
-  last_id_++;
-  const auto& nik = network_isolation_keys_[last_id_ % concurrency_];
+  last_id_ = ++g_last_connection_id;
+  size_t key_index = SelectNetworkIsolationKey();
+  if (balance_quic_sessions_) {
+    ++tunnels_by_key_[key_index];
+    key_index_by_id_[last_id_] = key_index;
+  }
   auto connection_ptr = std::make_unique<NaiveConnection>(
       last_id_, protocol_, std::move(padding_detector_delegate), proxy_info_,
-      server_ssl_config_, proxy_ssl_config_, resolver_, session_, nik, net_log_,
+      server_ssl_config_, proxy_ssl_config_, resolver_, socket_options_,
+      session_, network_isolation_keys_[key_index], net_log_,
       std::move(socket), traffic_annotation_);
   auto* connection = connection_ptr.get();
   connection_by_id_[connection->id()] = std::move(connection_ptr);
+  OnConnectionOpened();
+  FlightRecorder::Get()->Record(connection->id(), FlightEvent::kAccepted,
+                                static_cast<int>(protocol_));
   int result = connection->Connect(
       base::BindRepeating(&NaiveProxy::OnConnectComplete,
                           weak_ptr_factory_.GetWeakPtr(), connection->id()));
@@ -189,6 +216,13 @@ void NaiveProxy::Close(unsigned int connection_id, int reason) {
   base::ThreadTaskRunnerHandle::Get()->DeleteSoon(FROM_HERE,
                                                   std::move(it->second));
   connection_by_id_.erase(it);
+  auto key_it = key_index_by_id_.find(connection_id);
+  if (key_it != key_index_by_id_.end()) {
+    --tunnels_by_key_[key_it->second];
+    key_index_by_id_.erase(key_it);
+  }
+  OnConnectionClosed();
+  FlightRecorder::Get()->Record(connection_id, FlightEvent::kClosed, reason);
 }
 
 NaiveConnection* NaiveProxy::FindConnection(unsigned int connection_id) {
@@ -198,4 +232,38 @@ NaiveConnection* NaiveProxy::FindConnection(unsigned int connection_id) {
   return it->second.get();
 }
 
+size_t NaiveProxy::SelectNetworkIsolationKey() {
+  size_t round_robin = last_id_ % network_isolation_keys_.size();
+  const ProxyServer& proxy_server = proxy_info_.proxy_server();
+  if (!balance_quic_sessions_ || network_isolation_keys_.size() == 1 ||
+      !proxy_server.is_quic()) {
+    return round_robin;
+  }
+
+  // Each key has its own QUIC session. Tunnels are counted from accept, not
+  // from when their stream opens, so a burst of connections spreads over the
+  // sessions before any of them sends CONNECT. Ties go to the lower RTT; a
+  // session not yet up counts as zero RTT so it gets opened first.
+  QuicStreamFactory* factory = session_->quic_stream_factory();
+  size_t best = 0;
+  quic::QuicTime::Delta best_rtt = quic::QuicTime::Delta::Zero();
+  for (size_t i = 0; i < network_isolation_keys_.size(); ++i) {
+    quic::QuicTime::Delta rtt = quic::QuicTime::Delta::Zero();
+    QuicChromiumClientSession* session = factory->FindActiveSession(
+        proxy_server.host_port_pair(), network_isolation_keys_[i]);
+    if (session) {
+      rtt = session->connection()
+                ->sent_packet_manager()
+                .GetRttStats()
+                ->smoothed_rtt();
+    }
+    if (i == 0 || tunnels_by_key_[i] < tunnels_by_key_[best] ||
+        (tunnels_by_key_[i] == tunnels_by_key_[best] && rtt < best_rtt)) {
+      best = i;
+      best_rtt = rtt;
+    }
+  }
+  return best;
+}
+
 }  // namespace net
@@ -19,6 +19,7 @@
 #include "net/ssl/ssl_config.h"
 #include "net/tools/naive/naive_connection.h"
 #include "net/tools/naive/naive_protocol.h"
+#include "net/tools/naive/naive_socket_options.h"
 
 namespace net {
 
@@ -36,8 +37,10 @@ class NaiveProxy {
              ClientProtocol protocol,
              const std::string& listen_user,
              const std::string& listen_pass,
-             int concurrency,
+             const std::vector<NetworkIsolationKey>& network_isolation_keys,
+             bool balance_quic_sessions,
              RedirectResolver* resolver,
+             const SocketOptions& socket_options,
              HttpNetworkSession* session,
              const NetworkTrafficAnnotationTag& traffic_annotation);
   ~NaiveProxy();
@@ -59,15 +62,19 @@ class NaiveProxy {
 
   NaiveConnection* FindConnection(unsigned int connection_id);
 
+  // Returns the index of the key, and so the upstream session, for a new
+  // connection.
+  size_t SelectNetworkIsolationKey();
+
   std::unique_ptr<ServerSocket> listen_socket_;
   ClientProtocol protocol_;
   std::string listen_user_;
   std::string listen_pass_;
-  int concurrency_;
   ProxyInfo proxy_info_;
   SSLConfig server_ssl_config_;
   SSLConfig proxy_ssl_config_;
   RedirectResolver* resolver_;
+  SocketOptions socket_options_;
   HttpNetworkSession* session_;
   NetLogWithSource net_log_;
 
@@ -76,6 +83,13 @@ class NaiveProxy {
   std::unique_ptr<StreamSocket> accepted_socket_;
 
   std::vector<NetworkIsolationKey> network_isolation_keys_;
+  // Whether tunnels go to the QUIC session with the fewest open tunnels
+  // instead of round robin over |network_isolation_keys_|.
+  const bool balance_quic_sessions_;
+  // Open tunnels per key and the key of each tunnel, kept only when
+  // |balance_quic_sessions_|.
+  std::vector<size_t> tunnels_by_key_;
+  std::map<unsigned int, size_t> key_index_by_id_;
 
   std::map<unsigned int, std::unique_ptr<NaiveConnection>> connection_by_id_;
 
@@ -3,13 +3,17 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/at_exit.h"
+#include "base/barrier_closure.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/feature_list.h"
 #include "base/files/file_path.h"
@@ -21,21 +25,28 @@
 #include "base/run_loop.h"
 #include "base/strings/escape.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/system/sys_info.h"
 #include "base/task/single_thread_task_executor.h"
 #include "base/task/thread_pool/thread_pool_instance.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "build/build_config.h"
 #include "components/version_info/version_info.h"
 #include "net/base/auth.h"
+#include "net/base/hash_value.h"
 #include "net/base/network_isolation_key.h"
 #include "net/base/url_util.h"
 #include "net/cert/cert_verifier.h"
 #include "net/cert_net/cert_net_fetcher_url_request.h"
 #include "net/dns/host_resolver.h"
 #include "net/dns/mapped_host_resolver.h"
+#include "net/dns/public/dns_config_overrides.h"
+#include "net/dns/public/dns_over_https_server_config.h"
+#include "net/dns/public/secure_dns_mode.h"
+#include "net/dns/public/util.h"
 #include "net/http/http_auth.h"
 #include "net/http/http_auth_cache.h"
 #include "net/http/http_network_session.h"
@@ -51,12 +62,24 @@
 #include "net/proxy_resolution/proxy_config.h"
 #include "net/proxy_resolution/proxy_config_service_fixed.h"
 #include "net/proxy_resolution/proxy_config_with_annotation.h"
+#include "net/quic/quic_context.h"
+#include "net/quic/quic_stream_factory.h"
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/ssl_client_socket.h"
 #include "net/socket/tcp_server_socket.h"
+#include "net/socket/tcp_socket.h"
 #include "net/socket/udp_server_socket.h"
 #include "net/ssl/ssl_key_logger_impl.h"
+#include "net/third_party/quiche/src/quic/core/crypto/crypto_protocol.h"
+#include "net/third_party/quiche/src/quic/core/quic_constants.h"
+#include "net/third_party/quiche/src/quic/core/quic_tag.h"
 #include "net/third_party/quiche/src/quic/core/quic_versions.h"
+#include "net/third_party/quiche/src/quic/platform/api/quic_flags.h"
+#include "net/tools/naive/naive_allocator.h"
+#include "net/tools/naive/naive_client_socket_factory.h"
+#include "net/tools/naive/naive_cert_verifier.h"
+#include "net/tools/naive/naive_flight_recorder.h"
+#include "net/tools/naive/naive_net_log_observer.h"
 #include "net/tools/naive/naive_protocol.h"
 #include "net/tools/naive/naive_proxy.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
@@ -72,6 +95,12 @@
 #include "base/mac/scoped_nsautorelease_pool.h"
 #endif
 
+#if defined(OS_POSIX)
+#include <signal.h>
+
+#include "net/tools/naive/naive_signal_handler.h"
+#endif
+
 namespace {
 
 constexpr int kListenBackLog = 512;
@@ -82,35 +111,75 @@ constexpr net::NetworkTrafficAnnotationTag kTrafficAnnotation =
     net::DefineNetworkTrafficAnnotation("naive", "");
 
 struct CommandLine {
-  std::string listen;
+  std::vector<std::string> listens;
   std::string proxy;
+  std::string proxy_cert_pin;
+  base::StringPairs quic_options;
   std::string concurrency;
   std::string extra_headers;
   std::string host_resolver_rules;
+  std::string dns_over_https;
   std::string resolver_range;
+  std::string resolver_range6;
+  base::FilePath resolver_snapshot;
+  std::string resolver_snapshot_key;
+  std::string socket_send_buffer;
+  std::string socket_receive_buffer;
+  std::string tcp_notsent_lowat;
+  bool tcp_no_delay;
+  bool tcp_fast_open;
+  bool io_uring;
   bool no_log;
   base::FilePath log;
   base::FilePath log_net_log;
+  bool log_net_log_binary;
   base::FilePath ssl_key_log_file;
+  base::FilePath flight_recorder_dump;
+  base::FilePath cert_cache;
 };
 
-struct Params {
+struct ListenParams {
   net::ClientProtocol protocol;
   std::string listen_user;
   std::string listen_pass;
   std::string listen_addr;
   int listen_port;
+};
+
+struct Params {
+  std::vector<ListenParams> listens;
   int concurrency;
   net::HttpRequestHeaders extra_headers;
   std::string proxy_url;
   std::u16string proxy_user;
   std::u16string proxy_pass;
+  quic::QuicTagVector quic_connection_options;
+  quic::QuicTagVector quic_client_connection_options;
+  size_t quic_max_packet_length = 0;
+  uint32_t quic_session_window = 0;
+  uint32_t quic_stream_window = 0;
+  bool quic_port_migration = false;
+  base::TimeDelta quic_port_migration_period;
+  int quic_connections = 1;
+  bool quic_early_data = false;
+  std::string proxy_host;
+  net::HashValueVector proxy_cert_pins;
   std::string host_resolver_rules;
+  std::vector<net::DnsOverHttpsServerConfig> doh_servers;
   net::IPAddress resolver_range;
   size_t resolver_prefix;
+  net::IPAddress resolver_range6;
+  size_t resolver_prefix6 = 0;
+  base::FilePath resolver_snapshot_path;
+  std::string resolver_snapshot_key;
+  net::SocketOptions socket_options;
+  bool io_uring;
   logging::LoggingSettings log_settings;
   base::FilePath net_log_path;
+  bool net_log_binary;
   base::FilePath ssl_key_path;
+  base::FilePath flight_recorder_path;
+  base::FilePath cert_cache_path;
 };
 
 std::unique_ptr<base::Value> GetConstants() {
@@ -125,6 +194,25 @@ std::unique_ptr<base::Value> GetConstants() {
   return constants_dict;
 }
 
+#if defined(OS_POSIX)
+void ExitWithSignal(int signum) {
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+// Saves state that would be lost on termination, and runs its argument when
+// done.
+using ShutdownFlush = base::RepeatingCallback<void(base::OnceClosure)>;
+
+void FlushAndExitWithSignal(const std::vector<ShutdownFlush>& flushes,
+                            int signum) {
+  base::RepeatingClosure done = base::BarrierClosure(
+      flushes.size(), base::BindOnce(&ExitWithSignal, signum));
+  for (const ShutdownFlush& flush : flushes)
+    flush.Run(done);
+}
+#endif
+
 void GetCommandLine(const base::CommandLine& proc, CommandLine* cmdline) {
   if (proc.HasSwitch("h") || proc.HasSwitch("help")) {
     std::cout << "Usage: naive { OPTIONS | config.json }\n"
@@ -132,18 +220,36 @@ void GetCommandLine(const base::CommandLine& proc, CommandLine* cmdline) {
                  "Options:\n"
                  "-h, --help                 Show this message\n"
                  "--version                  Print version\n"
-                 "--listen=<proto>://[addr][:port]\n"
+                 "--listen=<proto>://[addr][:port] [--listen=...]\n"
                  "                           proto: socks, http\n"
                  "                                  redir (Linux only)\n"
                  "--proxy=<proto>://[<user>:<pass>@]<hostname>[:<port>]\n"
                  "                           proto: https, quic\n"
+                 "--quic-options=<key>=<value>[;...]\n"
+                 "                           QUIC tunnel options\n"
+                 "--proxy-cert-pin=sha256/<base64>[,...]\n"
+                 "                           Trust proxy keys without CA\n"
                  "--insecure-concurrency=<N> Use N connections, insecure\n"
                  "--extra-headers=...        Extra headers split by CRLF\n"
                  "--host-resolver-rules=...  Resolver rules\n"
+                 "--dns-over-https=<url>     Resolve names with DoH\n"
                  "--resolver-range=...       Redirect resolver range\n"
+                 "--resolver-range6=...      Redirect resolver IPv6 range\n"
+                 "--resolver-snapshot=<path> Keep fake addresses on restart\n"
+                 "--socket-send-buffer=<N>   Socket send buffer size\n"
+                 "--socket-receive-buffer=<N>\n"
+                 "                           Socket receive buffer size\n"
+                 "--tcp-notsent-lowat=<N>    Limit unsent bytes in sockets\n"
+                 "--tcp-no-delay             Disable Nagle on local sockets\n"
+                 "--tcp-fast-open            Use TCP Fast Open (Linux only)\n"
+                 "--io-uring                 Poll sockets with io_uring\n"
                  "--log[=<path>]             Log to stderr, or file\n"
                  "--log-net-log=<path>       Save NetLog\n"
+                 "--log-net-log-binary       Save NetLog in binary format\n"
                  "--ssl-key-log-file=<path>  Save SSL keys for Wireshark\n"
+                 "--flight-recorder-dump=<path>\n"
+                 "                           Dump recent events on SIGUSR2\n"
+                 "--cert-cache=<path>        Persist proxy cert results\n"
               << std::endl;
     exit(EXIT_SUCCESS);
   }
@@ -153,17 +259,55 @@ void GetCommandLine(const base::CommandLine& proc, CommandLine* cmdline) {
     exit(EXIT_SUCCESS);
   }
 
-  cmdline->listen = proc.GetSwitchValueASCII("listen");
+  // base::CommandLine only keeps the last value of a repeated switch.
+  static const base::CommandLine::StringType kListenPrefix =
+      FILE_PATH_LITERAL("--listen=");
+  for (const auto& arg : proc.argv()) {
+    if (arg.compare(0, kListenPrefix.size(), kListenPrefix) != 0)
+      continue;
+#if defined(OS_WIN)
+    cmdline->listens.push_back(
+        base::WideToUTF8(arg.substr(kListenPrefix.size())));
+#else
+    cmdline->listens.push_back(arg.substr(kListenPrefix.size()));
+#endif
+  }
   cmdline->proxy = proc.GetSwitchValueASCII("proxy");
+  cmdline->proxy_cert_pin = proc.GetSwitchValueASCII("proxy-cert-pin");
+  if (!base::SplitStringIntoKeyValuePairs(
+          proc.GetSwitchValueASCII("quic-options"), '=', ';',
+          &cmdline->quic_options)) {
+    std::cerr << "Invalid quic-options format" << std::endl;
+    exit(EXIT_FAILURE);
+  }
   cmdline->concurrency = proc.GetSwitchValueASCII("insecure-concurrency");
   cmdline->extra_headers = proc.GetSwitchValueASCII("extra-headers");
   cmdline->host_resolver_rules =
       proc.GetSwitchValueASCII("host-resolver-rules");
+  cmdline->dns_over_https = proc.GetSwitchValueASCII("dns-over-https");
   cmdline->resolver_range = proc.GetSwitchValueASCII("resolver-range");
+  cmdline->resolver_range6 = proc.GetSwitchValueASCII("resolver-range6");
+  cmdline->resolver_snapshot = proc.GetSwitchValuePath("resolver-snapshot");
+  // Secrets on the command line are visible to other users in ps.
+  if (proc.HasSwitch("resolver-snapshot-key")) {
+    std::cerr << "Set resolver-snapshot-key in the config file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  cmdline->socket_send_buffer = proc.GetSwitchValueASCII("socket-send-buffer");
+  cmdline->socket_receive_buffer =
+      proc.GetSwitchValueASCII("socket-receive-buffer");
+  cmdline->tcp_notsent_lowat = proc.GetSwitchValueASCII("tcp-notsent-lowat");
+  cmdline->tcp_no_delay = proc.HasSwitch("tcp-no-delay");
+  cmdline->tcp_fast_open = proc.HasSwitch("tcp-fast-open");
+  cmdline->io_uring = proc.HasSwitch("io-uring");
   cmdline->no_log = !proc.HasSwitch("log");
   cmdline->log = proc.GetSwitchValuePath("log");
   cmdline->log_net_log = proc.GetSwitchValuePath("log-net-log");
+  cmdline->log_net_log_binary = proc.HasSwitch("log-net-log-binary");
   cmdline->ssl_key_log_file = proc.GetSwitchValuePath("ssl-key-log-file");
+  cmdline->flight_recorder_dump =
+      proc.GetSwitchValuePath("flight-recorder-dump");
+  cmdline->cert_cache = proc.GetSwitchValuePath("cert-cache");
 }
 
 void GetCommandLineFromConfig(const base::FilePath& config_path,
@@ -181,14 +325,49 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
     std::cerr << "Invalid config format" << std::endl;
     exit(EXIT_FAILURE);
   }
-  const auto* listen = value->FindStringKey("listen");
-  if (listen) {
-    cmdline->listen = *listen;
+  const auto* listen = value->FindKey("listen");
+  if (listen && listen->is_string()) {
+    cmdline->listens.push_back(listen->GetString());
+  } else if (listen && listen->is_list()) {
+    for (const auto& listen_item : listen->GetList()) {
+      if (!listen_item.is_string()) {
+        std::cerr << "Invalid listen format" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      cmdline->listens.push_back(listen_item.GetString());
+    }
+  } else if (listen) {
+    std::cerr << "Invalid listen format" << std::endl;
+    exit(EXIT_FAILURE);
   }
   const auto* proxy = value->FindStringKey("proxy");
   if (proxy) {
     cmdline->proxy = *proxy;
   }
+  const auto* quic_options = value->FindKey("quic-options");
+  if (quic_options && quic_options->is_dict()) {
+    for (const auto kv : quic_options->DictItems()) {
+      std::string option;
+      if (kv.second.is_string()) {
+        option = kv.second.GetString();
+      } else if (kv.second.is_int()) {
+        option = base::NumberToString(kv.second.GetInt());
+      } else if (kv.second.is_bool()) {
+        option = kv.second.GetBool() ? "true" : "false";
+      } else {
+        std::cerr << "Invalid quic-options format" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      cmdline->quic_options.emplace_back(kv.first, option);
+    }
+  } else if (quic_options) {
+    std::cerr << "Invalid quic-options format" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const auto* proxy_cert_pin = value->FindStringKey("proxy-cert-pin");
+  if (proxy_cert_pin) {
+    cmdline->proxy_cert_pin = *proxy_cert_pin;
+  }
   const auto* concurrency = value->FindStringKey("insecure-concurrency");
   if (concurrency) {
     cmdline->concurrency = *concurrency;
@@ -201,10 +380,45 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
   if (host_resolver_rules) {
     cmdline->host_resolver_rules = *host_resolver_rules;
   }
+  const auto* dns_over_https = value->FindStringKey("dns-over-https");
+  if (dns_over_https) {
+    cmdline->dns_over_https = *dns_over_https;
+  }
   const auto* resolver_range = value->FindStringKey("resolver-range");
   if (resolver_range) {
     cmdline->resolver_range = *resolver_range;
   }
+  const auto* resolver_range6 = value->FindStringKey("resolver-range6");
+  if (resolver_range6) {
+    cmdline->resolver_range6 = *resolver_range6;
+  }
+  const auto* resolver_snapshot = value->FindStringKey("resolver-snapshot");
+  if (resolver_snapshot) {
+    cmdline->resolver_snapshot =
+        base::FilePath::FromUTF8Unsafe(*resolver_snapshot);
+  }
+  const auto* resolver_snapshot_key =
+      value->FindStringKey("resolver-snapshot-key");
+  if (resolver_snapshot_key) {
+    cmdline->resolver_snapshot_key = *resolver_snapshot_key;
+  }
+  const auto* socket_send_buffer = value->FindStringKey("socket-send-buffer");
+  if (socket_send_buffer) {
+    cmdline->socket_send_buffer = *socket_send_buffer;
+  }
+  const auto* socket_receive_buffer =
+      value->FindStringKey("socket-receive-buffer");
+  if (socket_receive_buffer) {
+    cmdline->socket_receive_buffer = *socket_receive_buffer;
+  }
+  const auto* tcp_notsent_lowat = value->FindStringKey("tcp-notsent-lowat");
+  if (tcp_notsent_lowat) {
+    cmdline->tcp_notsent_lowat = *tcp_notsent_lowat;
+  }
+  cmdline->tcp_no_delay = value->FindBoolKey("tcp-no-delay").value_or(false);
+  cmdline->tcp_fast_open =
+      value->FindBoolKey("tcp-fast-open").value_or(false);
+  cmdline->io_uring = value->FindBoolKey("io-uring").value_or(false);
   cmdline->no_log = true;
   const auto* log = value->FindStringKey("log");
   if (log) {
@@ -215,11 +429,23 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
   if (log_net_log) {
     cmdline->log_net_log = base::FilePath::FromUTF8Unsafe(*log_net_log);
   }
+  cmdline->log_net_log_binary =
+      value->FindBoolKey("log-net-log-binary").value_or(false);
   const auto* ssl_key_log_file = value->FindStringKey("ssl-key-log-file");
   if (ssl_key_log_file) {
     cmdline->ssl_key_log_file =
         base::FilePath::FromUTF8Unsafe(*ssl_key_log_file);
   }
+  const auto* flight_recorder_dump =
+      value->FindStringKey("flight-recorder-dump");
+  if (flight_recorder_dump) {
+    cmdline->flight_recorder_dump =
+        base::FilePath::FromUTF8Unsafe(*flight_recorder_dump);
+  }
+  const auto* cert_cache = value->FindStringKey("cert-cache");
+  if (cert_cache) {
+    cmdline->cert_cache = base::FilePath::FromUTF8Unsafe(*cert_cache);
+  }
 }
 
 std::string GetProxyFromURL(const GURL& url) {
@@ -230,52 +456,234 @@ std::string GetProxyFromURL(const GURL& url) {
   return str;
 }
 
-bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
+bool ParseListenURL(const std::string& listen, ListenParams* params) {
   params->protocol = net::ClientProtocol::kSocks5;
   params->listen_addr = "0.0.0.0";
   params->listen_port = 1080;
-  url::AddStandardScheme("socks",
-                         url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
-  url::AddStandardScheme("redir", url::SCHEME_WITH_HOST_AND_PORT);
-  if (!cmdline.listen.empty()) {
-    GURL url(cmdline.listen);
-    if (url.scheme() == "socks") {
-      params->protocol = net::ClientProtocol::kSocks5;
-      params->listen_port = 1080;
-    } else if (url.scheme() == "http") {
-      params->protocol = net::ClientProtocol::kHttp;
-      params->listen_port = 8080;
-    } else if (url.scheme() == "redir") {
+  if (listen.empty())
+    return true;
+
+  GURL url(listen);
+  if (url.scheme() == "socks") {
+    params->protocol = net::ClientProtocol::kSocks5;
+    params->listen_port = 1080;
+  } else if (url.scheme() == "http") {
+    params->protocol = net::ClientProtocol::kHttp;
+    params->listen_port = 8080;
+  } else if (url.scheme() == "redir") {
 #if defined(OS_LINUX)
-      params->protocol = net::ClientProtocol::kRedir;
-      params->listen_port = 1080;
+    params->protocol = net::ClientProtocol::kRedir;
+    params->listen_port = 1080;
 #else
-      std::cerr << "Redir protocol only supports Linux." << std::endl;
-      return false;
+    std::cerr << "Redir protocol only supports Linux." << std::endl;
+    return false;
 #endif
-    } else {
-      std::cerr << "Invalid scheme in --listen" << std::endl;
+  } else {
+    std::cerr << "Invalid scheme in --listen" << std::endl;
+    return false;
+  }
+  if (!url.username().empty()) {
+    params->listen_user = base::UnescapeBinaryURLComponent(url.username());
+  }
+  if (!url.password().empty()) {
+    params->listen_pass = base::UnescapeBinaryURLComponent(url.password());
+  }
+  if (!url.host().empty()) {
+    params->listen_addr = url.host();
+  }
+  if (!url.port().empty()) {
+    if (!base::StringToInt(url.port(), &params->listen_port)) {
+      std::cerr << "Invalid port in --listen" << std::endl;
       return false;
     }
-    if (!url.username().empty()) {
-      params->listen_user = base::UnescapeBinaryURLComponent(url.username());
-    }
-    if (!url.password().empty()) {
-      params->listen_pass = base::UnescapeBinaryURLComponent(url.password());
-    }
-    if (!url.host().empty()) {
-      params->listen_addr = url.host();
+    if (params->listen_port <= 0 ||
+        params->listen_port > std::numeric_limits<uint16_t>::max()) {
+      std::cerr << "Invalid port in --listen" << std::endl;
+      return false;
     }
-    if (!url.port().empty()) {
-      if (!base::StringToInt(url.port(), &params->listen_port)) {
-        std::cerr << "Invalid port in --listen" << std::endl;
+  }
+  return true;
+}
+
+// Maps user facing options to QUIC connection options. Tags in
+// |connection_options| are sent to the server and so also change how it
+// sends, while |client_connection_options| only affect the client.
+bool ParseQuicOptions(const base::StringPairs& options, Params* params) {
+  for (const auto& [key, value] : options) {
+    int number = 0;
+    bool is_number = base::StringToInt(value, &number) && number > 0;
+    if (key == "congestion-control") {
+      quic::QuicTag tag;
+      if (value == "bbr2") {
+        tag = quic::kB2ON;
+      } else if (value == "bbr") {
+        tag = quic::kTBBR;
+      } else if (value == "cubic") {
+        tag = quic::kQBIC;
+      } else if (value == "reno") {
+        tag = quic::kRENO;
+      } else {
+        std::cerr << "Invalid congestion-control in quic-options" << std::endl;
+        return false;
+      }
+      params->quic_connection_options.push_back(tag);
+      params->quic_client_connection_options.push_back(tag);
+    } else if (key == "initial-cwnd") {
+      quic::QuicTag tag;
+      if (value == "3") {
+        tag = quic::kIW03;
+      } else if (value == "10") {
+        tag = quic::kIW10;
+      } else if (value == "20") {
+        tag = quic::kIW20;
+      } else if (value == "50") {
+        tag = quic::kIW50;
+      } else {
+        std::cerr << "Invalid initial-cwnd in quic-options: use 3, 10, 20 or 50"
+                  << std::endl;
+        return false;
+      }
+      params->quic_connection_options.push_back(tag);
+      params->quic_client_connection_options.push_back(tag);
+    } else if (key == "max-packet-size") {
+      if (!is_number || number < 1200 ||
+          static_cast<size_t>(number) > quic::kMaxOutgoingPacketSize) {
+        std::cerr << "Invalid max-packet-size in quic-options" << std::endl;
+        return false;
+      }
+      params->quic_max_packet_length = number;
+    } else if (key == "mtu-discovery") {
+      quic::QuicTag tag;
+      if (value == "high") {
+        tag = quic::kMTUH;
+      } else if (value == "low") {
+        tag = quic::kMTUL;
+      } else {
+        std::cerr << "Invalid mtu-discovery in quic-options" << std::endl;
+        return false;
+      }
+      // The client only probes if it requests the option for itself too.
+      params->quic_connection_options.push_back(tag);
+      params->quic_client_connection_options.push_back(tag);
+    } else if (key == "ack-decimation") {
+      // Decimation starts after 100 packets, acking every 10 packets or after
+      // a quarter of min RTT.
+      if (value == "short") {
+        // An eighth of min RTT.
+        params->quic_connection_options.push_back(quic::kAKD3);
+      } else if (value == "unlimited") {
+        // No packet count limit, only the delay.
+        params->quic_connection_options.push_back(quic::kAKDU);
+      } else {
+        std::cerr << "Invalid ack-decimation in quic-options" << std::endl;
+        return false;
+      }
+    } else if (key == "ack-frequency") {
+      if (value == "false")
+        continue;
+      if (value != "true") {
+        std::cerr << "Invalid ack-frequency in quic-options" << std::endl;
+        return false;
+      }
+      // Advertises min_ack_delay and accepts ACK_FREQUENCY frames, and asks
+      // the server to send one based on its smoothed RTT once the handshake
+      // completes.
+      params->quic_client_connection_options.push_back(quic::kAFFE);
+      params->quic_connection_options.push_back(quic::kAFF1);
+      params->quic_connection_options.push_back(quic::kAFF2);
+    } else if (key == "early-data") {
+      if (value != "true" && value != "false") {
+        std::cerr << "Invalid early-data in quic-options" << std::endl;
+        return false;
+      }
+      params->quic_early_data = value == "true";
+    } else if (key == "session-window" || key == "stream-window") {
+      if (!is_number) {
+        std::cerr << "Invalid " << key << " in quic-options" << std::endl;
         return false;
       }
-      if (params->listen_port <= 0 ||
-          params->listen_port > std::numeric_limits<uint16_t>::max()) {
-        std::cerr << "Invalid port in --listen" << std::endl;
+      if (key == "session-window") {
+        params->quic_session_window = number;
+      } else {
+        params->quic_stream_window = number;
+      }
+    } else if (key == "connections") {
+      if (!is_number || number > 16) {
+        std::cerr << "Invalid connections in quic-options: use 1 to 16"
+                  << std::endl;
+        return false;
+      }
+      params->quic_connections = number;
+    } else if (key == "port-migration") {
+      // Path degrading is detected after this many PTOs without progress.
+      static constexpr quic::QuicTag kPtoTags[] = {
+          quic::kPDP1, quic::kPDP2, quic::kPDP3, quic::kPDP4, quic::kPDP5};
+      if (!is_number || number > 5) {
+        std::cerr << "Invalid port-migration in quic-options: use 1 to 5"
+                  << std::endl;
+        return false;
+      }
+      params->quic_port_migration = true;
+      params->quic_client_connection_options.push_back(kPtoTags[number - 1]);
+    } else if (key == "port-migration-period") {
+      if (!is_number) {
+        std::cerr << "Invalid port-migration-period in quic-options"
+                  << std::endl;
+        return false;
+      }
+      params->quic_port_migration_period = base::Seconds(number);
+    } else if (key == "connection-options") {
+      for (quic::QuicTag tag : quic::ParseQuicTagVector(value))
+        params->quic_connection_options.push_back(tag);
+    } else if (key == "client-connection-options") {
+      for (quic::QuicTag tag : quic::ParseQuicTagVector(value))
+        params->quic_client_connection_options.push_back(tag);
+    } else {
+      std::cerr << "Unknown quic-options key " << key << std::endl;
+      return false;
+    }
+  }
+  if (params->quic_connections > 1 &&
+      params->proxy_url.compare(0, 7, "quic://") != 0) {
+    std::cerr << "connections in quic-options requires a quic:// proxy"
+              << std::endl;
+    return false;
+  }
+  if (params->quic_early_data &&
+      params->proxy_url.compare(0, 7, "quic://") != 0) {
+    std::cerr << "early-data in quic-options requires a quic:// proxy"
+              << std::endl;
+    return false;
+  }
+  if (!params->quic_port_migration_period.is_zero() &&
+      !params->quic_port_migration) {
+    std::cerr << "port-migration-period requires port-migration" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
+  url::AddStandardScheme("socks",
+                         url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
+  url::AddStandardScheme("redir", url::SCHEME_WITH_HOST_AND_PORT);
+  if (cmdline.listens.empty()) {
+    params->listens.emplace_back();
+    ParseListenURL(std::string(), &params->listens.back());
+  }
+  bool has_redir = false;
+  for (const auto& listen : cmdline.listens) {
+    params->listens.emplace_back();
+    if (!ParseListenURL(listen, &params->listens.back()))
+      return false;
+    if (params->listens.back().protocol == net::ClientProtocol::kRedir) {
+      // Fake addresses from one resolver range can't be told apart across
+      // multiple resolvers.
+      if (has_redir) {
+        std::cerr << "Only one redir listener is supported" << std::endl;
         return false;
       }
+      has_redir = true;
     }
   }
 
@@ -291,9 +699,29 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
       return false;
     }
     params->proxy_url = GetProxyFromURL(url_no_auth);
+    params->proxy_host = url.HostNoBrackets();
     net::GetIdentityFromURL(url, &params->proxy_user, &params->proxy_pass);
   }
 
+  if (!ParseQuicOptions(cmdline.quic_options, params)) {
+    return false;
+  }
+
+  for (const auto& pin :
+       base::SplitString(cmdline.proxy_cert_pin, ",", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY)) {
+    net::HashValue hash;
+    if (!hash.FromString(pin) || hash.tag() != net::HASH_VALUE_SHA256) {
+      std::cerr << "Invalid proxy certificate pin" << std::endl;
+      return false;
+    }
+    params->proxy_cert_pins.push_back(hash);
+  }
+  if (!params->proxy_cert_pins.empty() && params->proxy_host.empty()) {
+    std::cerr << "Proxy certificate pin requires --proxy" << std::endl;
+    return false;
+  }
+
   if (!cmdline.concurrency.empty()) {
     if (!base::StringToInt(cmdline.concurrency, &params->concurrency) ||
         params->concurrency < 1) {
@@ -303,12 +731,30 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
   } else {
     params->concurrency = 1;
   }
+  // The two spread tunnels differently: round robin for concurrency, by
+  // load for QUIC connections.
+  if (params->concurrency > 1 && params->quic_connections > 1) {
+    std::cerr << "connections in quic-options can't be combined with "
+                 "insecure-concurrency"
+              << std::endl;
+    return false;
+  }
 
   params->extra_headers.AddHeadersFromString(cmdline.extra_headers);
 
   params->host_resolver_rules = cmdline.host_resolver_rules;
 
-  if (params->protocol == net::ClientProtocol::kRedir) {
+  if (!cmdline.dns_over_https.empty()) {
+    std::string method;
+    if (!net::dns_util::IsValidDohTemplate(cmdline.dns_over_https, &method)) {
+      std::cerr << "Invalid DNS-over-HTTPS template" << std::endl;
+      return false;
+    }
+    params->doh_servers.emplace_back(cmdline.dns_over_https,
+                                     /*use_post=*/method == "POST");
+  }
+
+  if (has_redir) {
     std::string range = "100.64.0.0/10";
     if (!cmdline.resolver_range.empty())
       range = cmdline.resolver_range;
@@ -322,8 +768,66 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
       std::cerr << "IPv6 resolver range not supported" << std::endl;
       return false;
     }
+
+    if (!cmdline.resolver_range6.empty()) {
+      // Fake IPv6 addresses embed the host part of fake IPv4 addresses.
+      if (!net::ParseCIDRBlock(cmdline.resolver_range6,
+                               &params->resolver_range6,
+                               &params->resolver_prefix6) ||
+          !params->resolver_range6.IsIPv6() ||
+          128 - params->resolver_prefix6 < 32 - params->resolver_prefix) {
+        std::cerr << "Invalid IPv6 resolver range" << std::endl;
+        return false;
+      }
+    }
+
+    if (!cmdline.resolver_snapshot.empty()) {
+      if (cmdline.resolver_snapshot_key.empty()) {
+        std::cerr << "Resolver snapshot requires resolver-snapshot-key in the "
+                     "config file"
+                  << std::endl;
+        return false;
+      }
+      params->resolver_snapshot_path = cmdline.resolver_snapshot;
+      params->resolver_snapshot_key = cmdline.resolver_snapshot_key;
+    }
   }
 
+  if (!cmdline.socket_send_buffer.empty()) {
+    if (!base::StringToInt(cmdline.socket_send_buffer,
+                           &params->socket_options.send_buffer_size) ||
+        params->socket_options.send_buffer_size < 1) {
+      std::cerr << "Invalid socket send buffer size" << std::endl;
+      return false;
+    }
+  }
+  if (!cmdline.socket_receive_buffer.empty()) {
+    if (!base::StringToInt(cmdline.socket_receive_buffer,
+                           &params->socket_options.receive_buffer_size) ||
+        params->socket_options.receive_buffer_size < 1) {
+      std::cerr << "Invalid socket receive buffer size" << std::endl;
+      return false;
+    }
+  }
+  if (!cmdline.tcp_notsent_lowat.empty()) {
+    if (!base::StringToInt(cmdline.tcp_notsent_lowat,
+                           &params->socket_options.notsent_lowat) ||
+        params->socket_options.notsent_lowat < 1) {
+      std::cerr << "Invalid TCP_NOTSENT_LOWAT" << std::endl;
+      return false;
+    }
+  }
+  params->socket_options.no_delay = cmdline.tcp_no_delay;
+  params->socket_options.fast_open = cmdline.tcp_fast_open;
+
+  params->io_uring = cmdline.io_uring;
+#if !defined(OS_LINUX) && !defined(OS_ANDROID)
+  if (params->io_uring) {
+    std::cerr << "io_uring only supports Linux." << std::endl;
+    return false;
+  }
+#endif
+
   if (!cmdline.no_log) {
     if (!cmdline.log.empty()) {
       params->log_settings.logging_dest = logging::LOG_TO_FILE;
@@ -336,8 +840,15 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
   }
 
   params->net_log_path = cmdline.log_net_log;
+  params->net_log_binary = cmdline.log_net_log_binary;
   params->ssl_key_path = cmdline.ssl_key_log_file;
 
+  // No default in the shared temporary directory: naive often runs as root,
+  // and the dump would follow a symlink planted there by any local user.
+  params->flight_recorder_path = cmdline.flight_recorder_dump;
+
+  params->cert_cache_path = cmdline.cert_cache;
+
   return true;
 }
 }  // namespace
@@ -408,11 +919,13 @@ std::unique_ptr<URLRequestContext> BuildCertURLRequestContext(NetLog* net_log) {
 std::unique_ptr<URLRequestContext> BuildURLRequestContext(
     const Params& params,
     scoped_refptr<CertNetFetcherURLRequest> cert_net_fetcher,
+    ClientSocketFactory* client_socket_factory,
     NetLog* net_log) {
   URLRequestContextBuilder builder;
 
   builder.DisableHttpCache();
   builder.set_net_log(net_log);
+  builder.set_client_socket_factory_for_testing(client_socket_factory);
 
   ProxyConfig proxy_config;
   proxy_config.proxy_rules().ParseFromString(params.proxy_url);
@@ -425,15 +938,65 @@ std::unique_ptr<URLRequestContext> BuildURLRequestContext(
   proxy_service->ForceReloadProxyConfig();
   builder.set_proxy_resolution_service(std::move(proxy_service));
 
-  if (!params.host_resolver_rules.empty()) {
-    builder.set_host_mapping_rules(params.host_resolver_rules);
+  // Direct connections and proxy hostname lookups never wait for DNS on warm
+  // names: recently expired entries are served while refreshed in background.
+  HostResolver::ManagerOptions resolver_options;
+  resolver_options.serve_stale_max_age = base::Hours(1);
+  if (!params.doh_servers.empty()) {
+    // Only the DoH servers and mode replace the system configuration, so
+    // hosts file entries still apply, and all other lookups except for the
+    // DoH server's own hostname use DoH.
+    resolver_options.dns_config_overrides.dns_over_https_servers =
+        params.doh_servers;
+    resolver_options.dns_config_overrides.secure_dns_mode =
+        SecureDnsMode::kSecure;
   }
+  builder.set_host_resolver(HostResolver::CreateStandaloneResolver(
+      net_log, resolver_options, params.host_resolver_rules,
+      /*enable_caching=*/true));
 
-  builder.SetCertVerifier(
-      CertVerifier::CreateDefault(std::move(cert_net_fetcher)));
+  auto cert_verifier = CertVerifier::CreateDefault(std::move(cert_net_fetcher));
+  if (!params.proxy_cert_pins.empty() || !params.cert_cache_path.empty()) {
+    cert_verifier = std::make_unique<NaiveCertVerifier>(
+        std::move(cert_verifier), params.proxy_host, params.proxy_cert_pins,
+        params.cert_cache_path);
+  }
+  builder.SetCertVerifier(std::move(cert_verifier));
 
   builder.set_proxy_delegate(
-      std::make_unique<NaiveProxyDelegate>(params.extra_headers));
+      std::make_unique<NaiveProxyDelegate>(params.extra_headers,
+                                           params.quic_early_data));
+
+  // Connection options are copied into the QuicStreamFactory's config when
+  // the session is built, so they must be set before Build().
+  auto quic_context = std::make_unique<QuicContext>();
+  QuicParams* quic_params = quic_context->params();
+  quic_params->connection_options = params.quic_connection_options;
+  quic_params->client_connection_options =
+      params.quic_client_connection_options;
+  if (params.quic_max_packet_length) {
+    quic_params->max_packet_length = params.quic_max_packet_length;
+  }
+  if (params.quic_session_window) {
+    quic_params->initial_session_flow_control_window =
+        params.quic_session_window;
+  }
+  if (params.quic_stream_window) {
+    quic_params->initial_stream_flow_control_window = params.quic_stream_window;
+  }
+  if (params.quic_port_migration) {
+    quic_params->allow_port_migration = true;
+    quic_params->port_migration_period = params.quic_port_migration_period;
+    // Keeps a packet in flight while streams are open, so that a dead NAT
+    // mapping is noticed before the tunnel has something to send.
+    quic_params->retransmittable_on_wire_timeout =
+        kDefaultRetransmittableOnWireTimeout;
+  }
+  if (quic::ContainsQuicTag(params.quic_client_connection_options,
+                            quic::kB2ON)) {
+    SetQuicReloadableFlag(quic_allow_client_enabled_bbr_v2, true);
+  }
+  builder.set_quic_context(std::move(quic_context));
 
   auto context = builder.Build();
 
@@ -458,22 +1021,22 @@ std::unique_ptr<URLRequestContext> BuildURLRequestContext(
 
   return context;
 }
+
+// Logs the state of the QUIC tunnel sessions, including their congestion
+// controller, so that quic-options can be compared on a live connection.
+void DumpQuicSessions(HttpNetworkSession* session) {
+  std::string json;
+  base::JSONWriter::WriteWithOptions(
+      *session->quic_stream_factory()->QuicStreamFactoryInfoToValue(),
+      base::JSONWriter::OPTIONS_PRETTY_PRINT, &json);
+  LOG(INFO) << "QUIC sessions: " << json;
+}
 }  // namespace
 }  // namespace net
 
 int main(int argc, char* argv[]) {
   url::AddStandardScheme("quic",
                          url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
-  base::FeatureList::InitializeInstance(
-      "PartitionConnectionsByNetworkIsolationKey", std::string());
-  base::SingleThreadTaskExecutor io_task_executor(base::MessagePumpType::IO);
-  base::ThreadPoolInstance::CreateAndStartWithDefaultParams("naive");
-  base::AtExitManager exit_manager;
-
-#if defined(OS_MACOSX)
-  base::mac::ScopedNSAutoreleasePool pool;
-#endif
-
   base::CommandLine::Init(argc, argv);
 
   CommandLine cmdline;
@@ -495,6 +1058,22 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
+  // The message pumps pick their backend on construction, so features must
+  // be set up before the task executor and thread pool are created.
+  std::string enabled_features = "PartitionConnectionsByNetworkIsolationKey";
+  if (params.io_uring) {
+    enabled_features += ",MessagePumpIOUring";
+  }
+  base::FeatureList::InitializeInstance(enabled_features, std::string());
+  net::ConfigureAllocator();
+  base::SingleThreadTaskExecutor io_task_executor(base::MessagePumpType::IO);
+  base::ThreadPoolInstance::CreateAndStartWithDefaultParams("naive");
+  base::AtExitManager exit_manager;
+
+#if defined(OS_MACOSX)
+  base::mac::ScopedNSAutoreleasePool pool;
+#endif
+
   net::ClientSocketPoolManager::set_max_sockets_per_pool(
       net::HttpNetworkSession::NORMAL_SOCKET_POOL,
       kDefaultMaxSocketsPerPool * kExpectedMaxUsers);
@@ -507,6 +1086,22 @@ int main(int argc, char* argv[]) {
 
   CHECK(logging::InitLogging(params.log_settings));
 
+  net::StartAllocatorPurging();
+#if defined(OS_POSIX)
+  net::SignalHandler signal_handler;
+  // Run on SIGINT and SIGTERM before terminating.
+  std::vector<ShutdownFlush> shutdown_flushes;
+  if (!params.flight_recorder_path.empty()) {
+    auto dump = base::BindRepeating(
+        &net::FlightRecorder::Dump,
+        base::Unretained(net::FlightRecorder::Get()),
+        params.flight_recorder_path);
+    if (!signal_handler.Watch(SIGUSR2, std::move(dump))) {
+      LOG(WARNING) << "Failed to watch SIGUSR2";
+    }
+  }
+#endif
+
   if (!params.ssl_key_path.empty()) {
     net::SSLClientSocket::SetSSLKeyLogger(
         std::make_unique<net::SSLKeyLoggerImpl>(params.ssl_key_path));
@@ -518,10 +1113,24 @@ int main(int argc, char* argv[]) {
   // printing_log_observer.
   net::NetLog* net_log = net::NetLog::Get();
   std::unique_ptr<net::FileNetLogObserver> observer;
+  std::unique_ptr<net::BinaryNetLogObserver> binary_observer;
   if (!params.net_log_path.empty()) {
-    observer = net::FileNetLogObserver::CreateUnbounded(
-        params.net_log_path, net::NetLogCaptureMode::kDefault, GetConstants());
-    observer->StartObserving(net_log);
+    if (params.net_log_binary) {
+      binary_observer = net::BinaryNetLogObserver::Create(params.net_log_path,
+                                                          GetConstants());
+      binary_observer->StartObserving(net_log,
+                                      net::NetLogCaptureMode::kDefault);
+#if defined(OS_POSIX)
+      shutdown_flushes.push_back(
+          base::BindRepeating(&net::BinaryNetLogObserver::Flush,
+                              base::Unretained(binary_observer.get())));
+#endif
+    } else {
+      observer = net::FileNetLogObserver::CreateUnbounded(
+          params.net_log_path, net::NetLogCaptureMode::kDefault,
+          GetConstants());
+      observer->StartObserving(net_log);
+    }
   }
 
   // Avoids net log overhead if verbose logging is disabled.
@@ -538,49 +1147,121 @@ int main(int argc, char* argv[]) {
   cert_net_fetcher = base::MakeRefCounted<net::CertNetFetcherURLRequest>();
   cert_net_fetcher->SetURLRequestContext(cert_context.get());
 #endif
-  auto context =
-      net::BuildURLRequestContext(params, std::move(cert_net_fetcher), net_log);
+  // With TCP Fast Open, connect() succeeds before the SYN is answered. That
+  // would hide unreachable origins and break address fallback for direct
+  // connections, so it is only used for connections to the proxy server,
+  // which are all the outbound TCP connections when there is one.
+  net::SocketOptions outbound_socket_options = params.socket_options;
+  if (params.proxy_url == "direct://")
+    outbound_socket_options.fast_open = false;
+  // Must outlive the URLRequestContext.
+  net::NaiveClientSocketFactory client_socket_factory(outbound_socket_options);
+  auto context = net::BuildURLRequestContext(
+      params, std::move(cert_net_fetcher), &client_socket_factory, net_log);
   auto* session = context->http_transaction_factory()->GetSession();
+#if defined(OS_POSIX)
+  auto dump_stats = base::BindRepeating(
+      [](net::HttpNetworkSession* session) {
+        net::DumpAllocatorStats();
+        net::DumpQuicSessions(session);
+      },
+      base::Unretained(session));
+  if (!signal_handler.Watch(SIGUSR1, std::move(dump_stats))) {
+    LOG(WARNING) << "Failed to watch SIGUSR1";
+  }
+#endif
 
-  auto listen_socket =
-      std::make_unique<net::TCPServerSocket>(net_log, net::NetLogSource());
-
-  int result = listen_socket->ListenWithAddressAndPort(
-      params.listen_addr, params.listen_port, kListenBackLog);
-  if (result != net::OK) {
-    LOG(ERROR) << "Failed to listen: " << result;
-    return EXIT_FAILURE;
+  // All listeners share one network session, so every local protocol is
+  // multiplexed over the same upstream tunnel sessions. Each key gets its own
+  // upstream session.
+  std::vector<net::NetworkIsolationKey> network_isolation_keys;
+  // At most one of concurrency and QUIC connections is above 1.
+  for (int i = 0; i < std::max(params.concurrency, params.quic_connections);
+       i++) {
+    network_isolation_keys.push_back(
+        net::NetworkIsolationKey::CreateTransient());
   }
-  LOG(INFO) << "Listening on " << params.listen_addr << ":"
-            << params.listen_port;
-
-  std::unique_ptr<net::RedirectResolver> resolver;
-  if (params.protocol == net::ClientProtocol::kRedir) {
-    auto resolver_socket =
-        std::make_unique<net::UDPServerSocket>(net_log, net::NetLogSource());
-    resolver_socket->AllowAddressReuse();
-    net::IPAddress listen_addr;
-    if (!listen_addr.AssignFromIPLiteral(params.listen_addr)) {
-      LOG(ERROR) << "Failed to open resolver: " << net::ERR_ADDRESS_INVALID;
-      return EXIT_FAILURE;
-    }
 
-    result = resolver_socket->Listen(
-        net::IPEndPoint(listen_addr, params.listen_port));
+  // There is at most one redir listener, so one resolver owns the snapshot
+  // file.
+  std::unique_ptr<net::RedirectResolver> redirect_resolver;
+  std::vector<std::unique_ptr<net::NaiveProxy>> naive_proxies;
+  for (const ListenParams& listen : params.listens) {
+    auto tcp_socket = std::make_unique<net::TCPSocket>(
+        /*socket_performance_watcher=*/nullptr, net_log, net::NetLogSource());
+    net::TCPSocket* listen_tcp_socket = tcp_socket.get();
+    auto listen_socket =
+        std::make_unique<net::TCPServerSocket>(std::move(tcp_socket));
+
+    int result = listen_socket->ListenWithAddressAndPort(
+        listen.listen_addr, listen.listen_port, kListenBackLog);
     if (result != net::OK) {
-      LOG(ERROR) << "Failed to open resolver: " << result;
+      LOG(ERROR) << "Failed to listen: " << result;
       return EXIT_FAILURE;
     }
+    if (params.socket_options.fast_open) {
+      result = net::EnableTCPFastOpenListen(listen_tcp_socket);
+      if (result != net::OK) {
+        LOG(WARNING) << "Failed to enable TCP Fast Open: " << result;
+      }
+    }
+    LOG(INFO) << "Listening on " << listen.listen_addr << ":"
+              << listen.listen_port;
+
+    net::RedirectResolver* resolver = nullptr;
+    if (listen.protocol == net::ClientProtocol::kRedir) {
+      auto resolver_socket =
+          std::make_unique<net::UDPServerSocket>(net_log, net::NetLogSource());
+      resolver_socket->AllowAddressReuse();
+      net::IPAddress listen_addr;
+      if (!listen_addr.AssignFromIPLiteral(listen.listen_addr)) {
+        LOG(ERROR) << "Failed to open resolver: " << net::ERR_ADDRESS_INVALID;
+        return EXIT_FAILURE;
+      }
 
-    resolver = std::make_unique<net::RedirectResolver>(
-        std::move(resolver_socket), params.resolver_range,
-        params.resolver_prefix);
+      result = resolver_socket->Listen(
+          net::IPEndPoint(listen_addr, listen.listen_port));
+      if (result != net::OK) {
+        LOG(ERROR) << "Failed to open resolver: " << result;
+        return EXIT_FAILURE;
+      }
+
+      DCHECK(!redirect_resolver);
+      redirect_resolver = std::make_unique<net::RedirectResolver>(
+          std::move(resolver_socket), params.resolver_range,
+          params.resolver_prefix, params.resolver_range6,
+          params.resolver_prefix6);
+      resolver = redirect_resolver.get();
+
+      if (!params.resolver_snapshot_path.empty()) {
+        resolver->EnableSnapshot(params.resolver_snapshot_path,
+                                 params.resolver_snapshot_key);
+#if defined(OS_POSIX)
+        shutdown_flushes.push_back(
+            base::BindRepeating(&net::RedirectResolver::FlushSnapshot,
+                                base::Unretained(resolver)));
+#endif
+      }
+    }
+
+    naive_proxies.push_back(std::make_unique<net::NaiveProxy>(
+        std::move(listen_socket), listen.protocol, listen.listen_user,
+        listen.listen_pass, network_isolation_keys,
+        /*balance_quic_sessions=*/params.quic_connections > 1, resolver,
+        params.socket_options, session, kTrafficAnnotation));
   }
 
-  net::NaiveProxy naive_proxy(std::move(listen_socket), params.protocol,
-                              params.listen_user, params.listen_pass,
-                              params.concurrency, resolver.get(), session,
-                              kTrafficAnnotation);
+#if defined(OS_POSIX)
+  if (!shutdown_flushes.empty()) {
+    for (int signum : {SIGINT, SIGTERM}) {
+      if (!signal_handler.Watch(
+              signum, base::BindRepeating(&FlushAndExitWithSignal,
+                                          shutdown_flushes, signum))) {
+        LOG(WARNING) << "Failed to watch signal " << signum;
+      }
+    }
+  }
+#endif
 
   base::RunLoop().Run();
 
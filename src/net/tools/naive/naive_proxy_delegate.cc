@@ -45,8 +45,9 @@ void FillNonindexHeaderValue(uint64_t unique_bits, char* buf, int len) {
   }
 }
 
-NaiveProxyDelegate::NaiveProxyDelegate(const HttpRequestHeaders& extra_headers)
-    : extra_headers_(extra_headers) {
+NaiveProxyDelegate::NaiveProxyDelegate(const HttpRequestHeaders& extra_headers,
+                                       bool early_payload)
+    : extra_headers_(extra_headers), early_payload_(early_payload) {
   InitializeNonindexCodes();
 }
 
@@ -68,6 +69,16 @@ void NaiveProxyDelegate::OnBeforeTunnelRequest(
   if (padding_state_by_server_[proxy_server] != PaddingSupport::kUnknown) {
     extra_headers->SetHeader("fastopen", "1");
   }
+  // Lets the H3 proxy client socket send the payload as 0-RTT data too, not
+  // just the CONNECT request. Only the H3 socket strips this header.
+  if (early_payload_ && proxy_server.is_quic()) {
+    extra_headers->SetHeader("early-payload", "1");
+  }
+  // The relay never writes into a buffer it has handed to Write() while the
+  // buffer is still referenced elsewhere, so the H3 socket may pin it.
+  if (proxy_server.is_quic()) {
+    extra_headers->SetHeader("pin-writes", "1");
+  }
   extra_headers->MergeFrom(extra_headers_);
 }
 
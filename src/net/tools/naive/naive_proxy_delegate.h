@@ -34,7 +34,8 @@ enum class PaddingSupport {
 
 class NaiveProxyDelegate : public ProxyDelegate {
  public:
-  explicit NaiveProxyDelegate(const HttpRequestHeaders& extra_headers);
+  NaiveProxyDelegate(const HttpRequestHeaders& extra_headers,
+                     bool early_payload);
   ~NaiveProxyDelegate() override;
 
   void OnResolveProxy(const GURL& url,
@@ -55,6 +56,7 @@ class NaiveProxyDelegate : public ProxyDelegate {
 
  private:
   const HttpRequestHeaders& extra_headers_;
+  const bool early_payload_;
   std::map<ProxyServer, PaddingSupport> padding_state_by_server_;
 };
 
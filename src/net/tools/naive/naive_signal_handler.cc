@@ -0,0 +1,94 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/tools/naive/naive_signal_handler.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include "base/check.h"
+#include "base/files/file_util.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/task/current_thread.h"
+
+namespace net {
+
+namespace {
+// Write end of the pipe, used from the async-signal context.
+int g_write_fd = -1;
+
+void OnSignal(int signal) {
+  int saved_errno = errno;
+  char byte = static_cast<char>(signal);
+  // A full pipe drops the signal, which is fine for on-demand dumps.
+  ignore_result(HANDLE_EINTR(write(g_write_fd, &byte, 1)));
+  errno = saved_errno;
+}
+}  // namespace
+
+SignalHandler::SignalHandler() : watch_controller_(FROM_HERE) {
+  DCHECK_EQ(g_write_fd, -1);
+  int fds[2];
+  if (!base::CreateLocalNonBlockingPipe(fds)) {
+    PLOG(ERROR) << "pipe";
+    return;
+  }
+  read_fd_ = fds[0];
+  g_write_fd = fds[1];
+  if (!base::CurrentIOThread::Get()->WatchFileDescriptor(
+          read_fd_, /*persistent=*/true, base::MessagePumpForIO::WATCH_READ,
+          &watch_controller_, this)) {
+    LOG(ERROR) << "Failed to watch signal pipe";
+  }
+}
+
+SignalHandler::~SignalHandler() {
+  for (const auto& entry : callbacks_) {
+    signal(entry.first, SIG_DFL);
+  }
+  watch_controller_.StopWatchingFileDescriptor();
+  if (g_write_fd >= 0) {
+    IGNORE_EINTR(close(g_write_fd));
+    g_write_fd = -1;
+  }
+  if (read_fd_ >= 0) {
+    IGNORE_EINTR(close(read_fd_));
+  }
+}
+
+bool SignalHandler::Watch(int signal, base::RepeatingClosure callback) {
+  if (read_fd_ < 0 || callbacks_.count(signal))
+    return false;
+
+  struct sigaction action = {};
+  action.sa_handler = OnSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(signal, &action, nullptr) != 0) {
+    PLOG(ERROR) << "sigaction";
+    return false;
+  }
+  callbacks_[signal] = std::move(callback);
+  return true;
+}
+
+void SignalHandler::OnFileCanReadWithoutBlocking(int fd) {
+  char signals[16];
+  ssize_t rv;
+  while ((rv = HANDLE_EINTR(read(fd, signals, sizeof(signals)))) > 0) {
+    for (ssize_t i = 0; i < rv; ++i) {
+      auto it = callbacks_.find(static_cast<unsigned char>(signals[i]));
+      if (it != callbacks_.end())
+        it->second.Run();
+    }
+  }
+}
+
+}  // namespace net
@@ -0,0 +1,38 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_SIGNAL_HANDLER_H_
+#define NET_TOOLS_NAIVE_NAIVE_SIGNAL_HANDLER_H_
+
+#include <map>
+
+#include "base/callback.h"
+#include "base/message_loop/message_pump_for_io.h"
+
+namespace net {
+
+// Runs callbacks on the network thread when the process receives signals.
+// The signal handler itself only writes the signal number to a pipe watched
+// by the message pump. At most one instance may exist.
+class SignalHandler : public base::MessagePumpForIO::FdWatcher {
+ public:
+  SignalHandler();
+  SignalHandler(const SignalHandler&) = delete;
+  SignalHandler& operator=(const SignalHandler&) = delete;
+  ~SignalHandler() override;
+
+  // Returns false on failure. Each signal can be watched once.
+  bool Watch(int signal, base::RepeatingClosure callback);
+
+  // base::MessagePumpForIO::FdWatcher:
+  void OnFileCanReadWithoutBlocking(int fd) override;
+  void OnFileCanWriteWithoutBlocking(int fd) override {}
+
+ private:
+  int read_fd_ = -1;
+  base::MessagePumpForIO::FdWatchController watch_controller_;
+  std::map<int, base::RepeatingClosure> callbacks_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_SIGNAL_HANDLER_H_
@@ -0,0 +1,96 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/naive_socket_options.h"
+
+#include "base/logging.h"
+#include "build/build_config.h"
+#include "net/base/net_errors.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/socket/tcp_socket.h"
+
+#if defined(OS_POSIX)
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+// Older sysroots may lack these.
+#ifndef TCP_FASTOPEN
+#define TCP_FASTOPEN 23
+#endif
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+#define NAIVE_HAS_TCP_FAST_OPEN
+#endif
+
+namespace net {
+
+namespace {
+// Maximum number of pending Fast Open requests not yet accepted.
+constexpr int kFastOpenQueueLength = 256;
+}  // namespace
+
+void ApplySocketOptions(TCPClientSocket* socket, const SocketOptions& options) {
+  DCHECK(socket);
+  int rv;
+  if (options.send_buffer_size > 0) {
+    rv = socket->SetSendBufferSize(options.send_buffer_size);
+    if (rv != OK)
+      LOG(WARNING) << "Failed to set send buffer size: " << rv;
+  }
+  if (options.receive_buffer_size > 0) {
+    rv = socket->SetReceiveBufferSize(options.receive_buffer_size);
+    if (rv != OK)
+      LOG(WARNING) << "Failed to set receive buffer size: " << rv;
+  }
+  if (options.no_delay) {
+    // If SetNoDelay fails, we don't care.
+    socket->SetNoDelay(true);
+  }
+#if defined(OS_POSIX) && defined(TCP_NOTSENT_LOWAT)
+  if (options.notsent_lowat > 0) {
+    int sd = socket->SocketDescriptorForTesting();
+    int lowat = options.notsent_lowat;
+    rv = setsockopt(sd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+    if (rv != 0)
+      PLOG(WARNING) << "Failed to set TCP_NOTSENT_LOWAT";
+  }
+#endif
+}
+
+int EnableTCPFastOpenListen(TCPSocket* socket) {
+  DCHECK(socket);
+#if defined(NAIVE_HAS_TCP_FAST_OPEN)
+  int sd = socket->SocketDescriptorForTesting();
+  int qlen = kFastOpenQueueLength;
+  if (setsockopt(sd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) != 0)
+    return MapSystemError(errno);
+  return OK;
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+int EnableTCPFastOpenConnect(TCPClientSocket* socket) {
+  DCHECK(socket);
+#if defined(NAIVE_HAS_TCP_FAST_OPEN)
+  int sd = socket->SocketDescriptorForTesting();
+  int enable = 1;
+  if (setsockopt(sd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enable,
+                 sizeof(enable)) != 0) {
+    // Kernels before 4.11 don't support it. Connects normally.
+    static bool warned = false;
+    if (!warned) {
+      warned = true;
+      PLOG(WARNING) << "Failed to set TCP_FASTOPEN_CONNECT";
+    }
+  }
+#endif
+  return OK;
+}
+
+}  // namespace net
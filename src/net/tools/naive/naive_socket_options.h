@@ -0,0 +1,39 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_NAIVE_SOCKET_OPTIONS_H_
+#define NET_TOOLS_NAIVE_NAIVE_SOCKET_OPTIONS_H_
+
+#include "net/socket/tcp_socket.h"
+
+namespace net {
+
+class TCPClientSocket;
+
+// Options applied to the accepted client sockets and to the direct server
+// sockets. Zero values leave the system defaults.
+struct SocketOptions {
+  int send_buffer_size = 0;
+  int receive_buffer_size = 0;
+  // Limits unsent data queued in the kernel. Writes beyond this limit return
+  // ERR_IO_PENDING, so slow clients push back on the tunnel instead of
+  // buffering megabytes in the socket.
+  int notsent_lowat = 0;
+  bool no_delay = false;
+  // Enables TCP Fast Open on the listen sockets and on outbound connections.
+  // Only supported on Linux.
+  bool fast_open = false;
+};
+
+void ApplySocketOptions(TCPClientSocket* socket, const SocketOptions& options);
+
+// Must be called on a listening socket.
+int EnableTCPFastOpenListen(TCPSocket* socket);
+
+// Must be called after the socket is opened and before it is connected. The
+// connect then returns immediately and the first write is sent in the SYN
+// if a Fast Open cookie is cached for the peer.
+int EnableTCPFastOpenConnect(TCPClientSocket* socket);
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_NAIVE_SOCKET_OPTIONS_H_
@@ -7,9 +7,18 @@
 #include <cstring>
 #include <iterator>
 #include <utility>
+#include <vector>
 
+#include "base/big_endian.h"
+#include "base/files/file_util.h"
+#include "base/files/important_file_writer.h"
 #include "base/logging.h"
+#include "base/task/sequenced_task_runner.h"
+#include "base/task/thread_pool.h"
 #include "base/threading/thread_task_runner_handle.h"
+#include "crypto/aead.h"
+#include "crypto/hkdf.h"
+#include "crypto/random.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_errors.h"
 #include "net/dns/dns_query.h"
@@ -22,9 +31,38 @@ namespace {
 constexpr int kUdpReadBufferSize = 1024;
 constexpr int kResolutionTtl = 60;
 constexpr int kResolutionRecycleTime = 60 * 5;
+constexpr base::TimeDelta kSnapshotInterval = base::Minutes(1);
+
+// Snapshot file: magic, nonce, then the AES-256-GCM sealed payload with the
+// magic as additional data. The payload is big endian:
+//
+//   u64 save time, microseconds since the Windows epoch
+//   u32 next offset
+//   u32 entry count
+//   entries from least to most recently used:
+//     u32 IPv4 address
+//     u32 seconds since last use
+//     u8 name length, name
+constexpr char kSnapshotMagic[] = "NAIVERS1";
+constexpr size_t kSnapshotMagicSize = sizeof(kSnapshotMagic) - 1;
+constexpr size_t kSnapshotHeaderSize = 8 + 4 + 4;
+
+void WriteSnapshot(const base::FilePath& path, const std::string& data) {
+  if (!base::ImportantFileWriter::WriteFileAtomically(path, data))
+    LOG(ERROR) << "Failed to save resolver snapshot to " << path;
+}
+
+net::IPAddress PackedToIPv4(uint32_t addr) {
+  return net::IPAddress(addr >> 24, addr >> 16, addr >> 8, addr);
+}
+
+uint32_t IPv4ToPacked(const net::IPAddress& address) {
+  return (address.bytes()[0] << 24) | (address.bytes()[1] << 16) |
+         (address.bytes()[2] << 8) | address.bytes()[3];
+}
 
 std::string PackedIPv4ToString(uint32_t addr) {
-  return net::IPAddress(addr >> 24, addr >> 16, addr >> 8, addr).ToString();
+  return PackedToIPv4(addr).ToString();
 }
 }  // namespace
 
@@ -36,10 +74,14 @@ Resolution::~Resolution() = default;
 
 RedirectResolver::RedirectResolver(std::unique_ptr<DatagramServerSocket> socket,
                                    const IPAddress& range,
-                                   size_t prefix)
+                                   size_t prefix,
+                                   const IPAddress& range6,
+                                   size_t prefix6)
     : socket_(std::move(socket)),
       range_(range),
       prefix_(prefix),
+      range6_(range6),
+      prefix6_(prefix6),
       offset_(0),
       buffer_(base::MakeRefCounted<IOBufferWithSize>(kUdpReadBufferSize)) {
   DCHECK(socket_);
@@ -98,149 +140,306 @@ int RedirectResolver::HandleReadResult(int result) {
     return ERR_INVALID_ARGUMENT;
   }
 
-  int size;
-  if (query.qtype() == dns_protocol::kTypeA) {
-    Resolution res;
-
+  // Every name gets a fake IPv4 address, and a fake IPv6 address derived from
+  // it if there is an IPv6 range. Other types get an empty NOERROR (NODATA)
+  // answer, rather than SERVFAIL which makes clients retry and time out.
+  std::vector<DnsResourceRecord> answers;
+  if (query.qtype() == dns_protocol::kTypeA ||
+      (query.qtype() == dns_protocol::kTypeAAAA && !range6_.empty())) {
     auto name_or = DnsDomainToString(query.qname());
     if (!name_or) {
       LOG(INFO) << "Malformed DNS query from " << recv_address_.ToString();
       return ERR_INVALID_ARGUMENT;
     }
     const auto& name = name_or.value();
-
-    auto by_name_lookup = resolution_by_name_.emplace(name, resolutions_.end());
-    auto by_name = by_name_lookup.first;
-    bool has_name = !by_name_lookup.second;
-    if (has_name) {
-      auto res_it = by_name->second;
-      auto by_addr = res_it->by_addr;
-      uint32_t addr = res_it->addr;
-
-      resolutions_.erase(res_it);
-      resolutions_.emplace_back();
-      res_it = std::prev(resolutions_.end());
-
-      by_name->second = res_it;
-      by_addr->second = res_it;
-      res_it->addr = addr;
-      res_it->name = name;
-      res_it->time = base::TimeTicks::Now();
-      res_it->by_name = by_name;
-      res_it->by_addr = by_addr;
-    } else {
-      uint32_t addr = (range_.bytes()[0] << 24) | (range_.bytes()[1] << 16) |
-                      (range_.bytes()[2] << 8) | range_.bytes()[3];
-      uint32_t subnet = ~0U >> prefix_;
-      addr &= ~subnet;
-      addr += offset_;
-      offset_ = (offset_ + 1) & subnet;
-
-      auto by_addr_lookup =
-          resolution_by_addr_.emplace(addr, resolutions_.end());
-      auto by_addr = by_addr_lookup.first;
-      bool has_addr = !by_addr_lookup.second;
-      if (has_addr) {
-        // Too few available addresses. Overwrites old one.
-        auto res_it = by_addr->second;
-
-        LOG(INFO) << "Overwrite " << res_it->name << " "
-                  << PackedIPv4ToString(res_it->addr) << " with " << name << " "
-                  << PackedIPv4ToString(addr);
-        resolution_by_name_.erase(res_it->by_name);
-        resolutions_.erase(res_it);
-        resolutions_.emplace_back();
-        res_it = std::prev(resolutions_.end());
-
-        by_name->second = res_it;
-        by_addr->second = res_it;
-        res_it->addr = addr;
-        res_it->name = name;
-        res_it->time = base::TimeTicks::Now();
-        res_it->by_name = by_name;
-        res_it->by_addr = by_addr;
-      } else {
-        LOG(INFO) << "Add " << name << " " << PackedIPv4ToString(addr);
-        resolutions_.emplace_back();
-        auto res_it = std::prev(resolutions_.end());
-
-        by_name->second = res_it;
-        by_addr->second = res_it;
-        res_it->addr = addr;
-        res_it->name = name;
-        res_it->time = base::TimeTicks::Now();
-        res_it->by_name = by_name;
-        res_it->by_addr = by_addr;
-
-        // Collects garbage.
-        auto now = base::TimeTicks::Now();
-        for (auto it = resolutions_.begin();
-             it != resolutions_.end() &&
-             (now - it->time).InSeconds() > kResolutionRecycleTime;) {
-          auto next = std::next(it);
-          LOG(INFO) << "Drop " << it->name << " "
-                    << PackedIPv4ToString(it->addr);
-          resolution_by_name_.erase(it->by_name);
-          resolution_by_addr_.erase(it->by_addr);
-          resolutions_.erase(it);
-          it = next;
-        }
-      }
-    }
+    uint32_t addr = Resolve(name);
 
     DnsResourceRecord record;
     record.name = name;
-    record.type = dns_protocol::kTypeA;
+    record.type = query.qtype();
     record.klass = dns_protocol::kClassIN;
     record.ttl = kResolutionTtl;
-    uint32_t addr = by_name->second->addr;
-    record.SetOwnedRdata(IPAddressToPackedString(
-        IPAddress(addr >> 24, addr >> 16, addr >> 8, addr)));
-    absl::optional<DnsQuery> query_opt;
-    query_opt.emplace(query.id(), query.qname(), query.qtype());
-    DnsResponse response(query.id(), /*is_authoritative=*/false,
-                         /*answers=*/{std::move(record)},
-                         /*authority_records=*/{}, /*additional_records=*/{},
-                         query_opt);
-    size = response.io_buffer_size();
-    if (size > buffer_->size() || !response.io_buffer()) {
-      return ERR_NO_BUFFER_SPACE;
-    }
-    std::memcpy(buffer_->data(), response.io_buffer()->data(), size);
-  } else {
-    absl::optional<DnsQuery> query_opt;
-    query_opt.emplace(query.id(), query.qname(), query.qtype());
-    DnsResponse response(query.id(), /*is_authoritative=*/false, /*answers=*/{},
-                         /*authority_records=*/{}, /*additional_records=*/{},
-                         query_opt, dns_protocol::kRcodeSERVFAIL);
-    size = response.io_buffer_size();
-    if (size > buffer_->size() || !response.io_buffer()) {
-      return ERR_NO_BUFFER_SPACE;
+    if (query.qtype() == dns_protocol::kTypeA) {
+      record.SetOwnedRdata(IPAddressToPackedString(PackedToIPv4(addr)));
+    } else {
+      record.SetOwnedRdata(IPAddressToPackedString(ToIPv6(addr)));
     }
-    std::memcpy(buffer_->data(), response.io_buffer()->data(), size);
+    answers.push_back(std::move(record));
+  }
+
+  absl::optional<DnsQuery> query_opt;
+  query_opt.emplace(query.id(), query.qname(), query.qtype());
+  DnsResponse response(query.id(), /*is_authoritative=*/false,
+                       answers, /*authority_records=*/{},
+                       /*additional_records=*/{}, query_opt);
+  int size = response.io_buffer_size();
+  if (size > buffer_->size() || !response.io_buffer()) {
+    return ERR_NO_BUFFER_SPACE;
   }
+  std::memcpy(buffer_->data(), response.io_buffer()->data(), size);
 
   return socket_->SendTo(
       buffer_.get(), size, recv_address_,
       base::BindOnce(&RedirectResolver::OnSend, base::Unretained(this)));
 }
 
+uint32_t RedirectResolver::Resolve(const std::string& name) {
+  snapshot_dirty_ = true;
+  auto by_name_lookup = resolution_by_name_.emplace(name, resolutions_.end());
+  auto by_name = by_name_lookup.first;
+  bool has_name = !by_name_lookup.second;
+  if (has_name) {
+    auto res_it = by_name->second;
+    auto by_addr = res_it->by_addr;
+    uint32_t addr = res_it->addr;
+
+    resolutions_.erase(res_it);
+    resolutions_.emplace_back();
+    res_it = std::prev(resolutions_.end());
+
+    by_name->second = res_it;
+    by_addr->second = res_it;
+    res_it->addr = addr;
+    res_it->name = name;
+    res_it->time = base::TimeTicks::Now();
+    res_it->by_name = by_name;
+    res_it->by_addr = by_addr;
+    return addr;
+  }
+
+  uint32_t addr = IPv4ToPacked(range_);
+  uint32_t subnet = ~0U >> prefix_;
+  addr &= ~subnet;
+  addr += offset_;
+  offset_ = (offset_ + 1) & subnet;
+
+  auto by_addr_lookup = resolution_by_addr_.emplace(addr, resolutions_.end());
+  auto by_addr = by_addr_lookup.first;
+  bool has_addr = !by_addr_lookup.second;
+  if (has_addr) {
+    // Too few available addresses. Overwrites old one.
+    auto res_it = by_addr->second;
+
+    LOG(INFO) << "Overwrite " << res_it->name << " "
+              << PackedIPv4ToString(res_it->addr) << " with " << name << " "
+              << PackedIPv4ToString(addr);
+    resolution_by_name_.erase(res_it->by_name);
+    resolutions_.erase(res_it);
+    resolutions_.emplace_back();
+    res_it = std::prev(resolutions_.end());
+
+    by_name->second = res_it;
+    by_addr->second = res_it;
+    res_it->addr = addr;
+    res_it->name = name;
+    res_it->time = base::TimeTicks::Now();
+    res_it->by_name = by_name;
+    res_it->by_addr = by_addr;
+    return addr;
+  }
+
+  LOG(INFO) << "Add " << name << " " << PackedIPv4ToString(addr);
+  resolutions_.emplace_back();
+  auto res_it = std::prev(resolutions_.end());
+
+  by_name->second = res_it;
+  by_addr->second = res_it;
+  res_it->addr = addr;
+  res_it->name = name;
+  res_it->time = base::TimeTicks::Now();
+  res_it->by_name = by_name;
+  res_it->by_addr = by_addr;
+
+  // Collects garbage.
+  auto now = base::TimeTicks::Now();
+  for (auto it = resolutions_.begin();
+       it != resolutions_.end() &&
+       (now - it->time).InSeconds() > kResolutionRecycleTime;) {
+    auto next = std::next(it);
+    LOG(INFO) << "Drop " << it->name << " " << PackedIPv4ToString(it->addr);
+    resolution_by_name_.erase(it->by_name);
+    resolution_by_addr_.erase(it->by_addr);
+    resolutions_.erase(it);
+    it = next;
+  }
+  return addr;
+}
+
+IPAddress RedirectResolver::ToIPv6(uint32_t addr) const {
+  // The host part of the IPv4 address goes into the low bits of the IPv6
+  // range, which has at least as many host bits.
+  uint32_t subnet = ~0U >> prefix_;
+  auto bytes = range6_.bytes();
+  uint32_t low = (bytes[12] << 24) | (bytes[13] << 16) | (bytes[14] << 8) |
+                 bytes[15];
+  low = (low & ~subnet) | (addr & subnet);
+  bytes[12] = low >> 24;
+  bytes[13] = low >> 16;
+  bytes[14] = low >> 8;
+  bytes[15] = low;
+  return IPAddress(bytes);
+}
+
 bool RedirectResolver::IsInResolvedRange(const IPAddress& address) const {
-  if (!address.IsIPv4())
-    return false;
-  return IPAddressMatchesPrefix(address, range_, prefix_);
+  if (address.IsIPv4())
+    return IPAddressMatchesPrefix(address, range_, prefix_);
+  if (address.IsIPv6() && !range6_.empty())
+    return IPAddressMatchesPrefix(address, range6_, prefix6_);
+  return false;
 }
 
 std::string RedirectResolver::FindNameByAddress(
     const IPAddress& address) const {
-  if (!address.IsIPv4())
+  uint32_t addr;
+  if (address.IsIPv4()) {
+    addr = IPv4ToPacked(address);
+  } else if (address.IsIPv6() && !range6_.empty() &&
+             IPAddressMatchesPrefix(address, range6_, prefix6_)) {
+    const auto& bytes = address.bytes();
+    uint32_t low = (bytes[12] << 24) | (bytes[13] << 16) | (bytes[14] << 8) |
+                   bytes[15];
+    uint32_t subnet = ~0U >> prefix_;
+    addr = (IPv4ToPacked(range_) & ~subnet) | (low & subnet);
+  } else {
     return {};
-  uint32_t addr = (address.bytes()[0] << 24) | (address.bytes()[1] << 16) |
-                  (address.bytes()[2] << 8) | address.bytes()[3];
+  }
   auto by_addr = resolution_by_addr_.find(addr);
   if (by_addr == resolution_by_addr_.end())
     return {};
   return by_addr->second->name;
 }
 
+void RedirectResolver::EnableSnapshot(const base::FilePath& path,
+                                      const std::string& secret) {
+  snapshot_path_ = path;
+  snapshot_key_ = crypto::HkdfSha256(secret, /*salt=*/kSnapshotMagic,
+                                     /*info=*/{}, /*derived_key_size=*/32);
+  snapshot_task_runner_ = base::ThreadPool::CreateSequencedTaskRunner(
+      {base::MayBlock(), base::TaskPriority::USER_VISIBLE});
+  LoadSnapshot();
+  snapshot_timer_.Start(FROM_HERE, kSnapshotInterval, this,
+                        &RedirectResolver::OnSnapshotTimer);
+}
+
+void RedirectResolver::FlushSnapshot(base::OnceClosure callback) {
+  if (snapshot_path_.empty()) {
+    std::move(callback).Run();
+    return;
+  }
+  snapshot_dirty_ = false;
+  snapshot_task_runner_->PostTaskAndReply(
+      FROM_HERE,
+      base::BindOnce(&WriteSnapshot, snapshot_path_, SerializeSnapshot()),
+      std::move(callback));
+}
+
+void RedirectResolver::OnSnapshotTimer() {
+  if (!snapshot_dirty_)
+    return;
+  snapshot_dirty_ = false;
+  snapshot_task_runner_->PostTask(
+      FROM_HERE,
+      base::BindOnce(&WriteSnapshot, snapshot_path_, SerializeSnapshot()));
+}
+
+std::string RedirectResolver::SerializeSnapshot() const {
+  size_t size = kSnapshotHeaderSize;
+  for (const Resolution& res : resolutions_)
+    size += 4 + 4 + 1 + res.name.size();
+
+  std::string payload(size, '\0');
+  base::BigEndianWriter writer(payload.data(), payload.size());
+  writer.WriteU64(
+      base::Time::Now().ToDeltaSinceWindowsEpoch().InMicroseconds());
+  writer.WriteU32(offset_);
+  writer.WriteU32(resolutions_.size());
+  auto now = base::TimeTicks::Now();
+  for (const Resolution& res : resolutions_) {
+    writer.WriteU32(res.addr);
+    writer.WriteU32((now - res.time).InSeconds());
+    // DNS names are at most 255 bytes.
+    writer.WriteU8(res.name.size());
+    writer.WriteBytes(res.name.data(), res.name.size());
+  }
+
+  crypto::Aead aead(crypto::Aead::AES_256_GCM);
+  aead.Init(&snapshot_key_);
+  std::string nonce(aead.NonceLength(), '\0');
+  crypto::RandBytes(nonce.data(), nonce.size());
+  std::string ciphertext;
+  aead.Seal(payload, nonce,
+            base::StringPiece(kSnapshotMagic, kSnapshotMagicSize),
+            &ciphertext);
+  return std::string(kSnapshotMagic, kSnapshotMagicSize) + nonce + ciphertext;
+}
+
+void RedirectResolver::LoadSnapshot() {
+  std::string data;
+  if (!base::ReadFileToString(snapshot_path_, &data))
+    return;
+
+  crypto::Aead aead(crypto::Aead::AES_256_GCM);
+  aead.Init(&snapshot_key_);
+  const size_t nonce_size = aead.NonceLength();
+  std::string payload;
+  if (data.size() < kSnapshotMagicSize + nonce_size ||
+      data.compare(0, kSnapshotMagicSize, kSnapshotMagic) != 0 ||
+      !aead.Open(base::StringPiece(data).substr(kSnapshotMagicSize +
+                                                nonce_size),
+                 base::StringPiece(data).substr(kSnapshotMagicSize,
+                                                nonce_size),
+                 base::StringPiece(kSnapshotMagic, kSnapshotMagicSize),
+                 &payload)) {
+    LOG(WARNING) << "Ignoring invalid resolver snapshot " << snapshot_path_;
+    return;
+  }
+
+  base::BigEndianReader reader(payload.data(), payload.size());
+  uint64_t saved_us;
+  uint32_t offset;
+  uint32_t count;
+  if (!reader.ReadU64(&saved_us) || !reader.ReadU32(&offset) ||
+      !reader.ReadU32(&count)) {
+    LOG(WARNING) << "Ignoring invalid resolver snapshot " << snapshot_path_;
+    return;
+  }
+  base::TimeDelta downtime =
+      base::Time::Now() - base::Time::FromDeltaSinceWindowsEpoch(
+                              base::Microseconds(saved_us));
+  if (downtime < base::TimeDelta())
+    downtime = base::TimeDelta();
+
+  // The range may have changed since the snapshot was saved.
+  uint32_t subnet = ~0U >> prefix_;
+  uint32_t base_addr = IPv4ToPacked(range_) & ~subnet;
+  offset_ = offset & subnet;
+
+  auto now = base::TimeTicks::Now();
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t addr;
+    uint32_t idle;
+    base::StringPiece name_piece;
+    if (!reader.ReadU32(&addr) || !reader.ReadU32(&idle) ||
+        !reader.ReadU8LengthPrefixed(&name_piece)) {
+      LOG(WARNING) << "Truncated resolver snapshot " << snapshot_path_;
+      break;
+    }
+    std::string name(name_piece);
+    if (name.empty() || (addr & ~subnet) != base_addr ||
+        resolution_by_name_.count(name) || resolution_by_addr_.count(addr)) {
+      continue;
+    }
+
+    resolutions_.emplace_back();
+    auto res_it = std::prev(resolutions_.end());
+    res_it->addr = addr;
+    res_it->name = name;
+    res_it->time = now - base::Seconds(idle) - downtime;
+    res_it->by_name = resolution_by_name_.emplace(name, res_it).first;
+    res_it->by_addr = resolution_by_addr_.emplace(addr, res_it).first;
+  }
+  LOG(INFO) << "Loaded " << resolutions_.size() << " resolutions from "
+            << snapshot_path_;
+}
+
 }  // namespace net
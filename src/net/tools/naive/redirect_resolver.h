@@ -11,13 +11,20 @@
 #include <memory>
 #include <string>
 
+#include "base/callback.h"
+#include "base/files/file_path.h"
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
+#include "base/timer/timer.h"
 #include "net/base/ip_address.h"
 #include "net/base/ip_endpoint.h"
 
+namespace base {
+class SequencedTaskRunner;
+}  // namespace base
+
 namespace net {
 
 class DatagramServerSocket;
@@ -34,25 +41,45 @@ struct Resolution {
   std::map<uint32_t, std::list<Resolution>::iterator>::iterator by_addr;
 };
 
+// Answers A queries with fake addresses from |range|, and AAAA queries with
+// fake addresses from |range6| unless it is empty, so that connections
+// redirected to the fake addresses can be mapped back to names.
 class RedirectResolver {
  public:
   RedirectResolver(std::unique_ptr<DatagramServerSocket> socket,
                    const IPAddress& range,
-                   size_t prefix);
+                   size_t prefix,
+                   const IPAddress& range6,
+                   size_t prefix6);
   ~RedirectResolver();
 
   bool IsInResolvedRange(const IPAddress& address) const;
   std::string FindNameByAddress(const IPAddress& address) const;
 
+  // Loads fake addresses saved in |path|, then saves them there every minute
+  // if they changed, encrypted with a key derived from |secret|. Keeping them
+  // across restarts lets downstream keep using cached results.
+  void EnableSnapshot(const base::FilePath& path, const std::string& secret);
+  // Saves fake addresses now and runs |callback| when written.
+  void FlushSnapshot(base::OnceClosure callback);
+
  private:
   void DoRead();
   void OnRecv(int result);
   void OnSend(int result);
   int HandleReadResult(int result);
+  // Returns the packed fake IPv4 address of |name|, assigning one if needed.
+  uint32_t Resolve(const std::string& name);
+  IPAddress ToIPv6(uint32_t addr) const;
+  void LoadSnapshot();
+  std::string SerializeSnapshot() const;
+  void OnSnapshotTimer();
 
   std::unique_ptr<DatagramServerSocket> socket_;
   IPAddress range_;
   size_t prefix_;
+  IPAddress range6_;
+  size_t prefix6_;
   uint32_t offset_;
   scoped_refptr<IOBufferWithSize> buffer_;
   IPEndPoint recv_address_;
@@ -61,6 +88,12 @@ class RedirectResolver {
   std::map<uint32_t, std::list<Resolution>::iterator> resolution_by_addr_;
   std::list<Resolution> resolutions_;
 
+  base::FilePath snapshot_path_;
+  std::string snapshot_key_;
+  bool snapshot_dirty_ = false;
+  base::RepeatingTimer snapshot_timer_;
+  scoped_refptr<base::SequencedTaskRunner> snapshot_task_runner_;
+
   base::WeakPtrFactory<RedirectResolver> weak_ptr_factory_{this};
 
   DISALLOW_COPY_AND_ASSIGN(RedirectResolver);
@@ -5,6 +5,7 @@
 
 #include "net/tools/naive/socks5_server_socket.h"
 
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -27,6 +28,9 @@ enum SocksCommandType {
   kCommandUDPAssociate = 0x03,
 };
 
+// Large enough for the whole handshake and some early data, e.g. a TLS
+// ClientHello.
+static constexpr int kReadBufferSize = 16 * 1024;
 static constexpr unsigned int kGreetReadHeaderSize = 2;
 static constexpr unsigned int kAuthReadHeaderSize = 2;
 static constexpr unsigned int kReadHeaderSize = 5;
@@ -53,8 +57,12 @@ Socks5ServerSocket::Socks5ServerSocket(
                                        base::Unretained(this))),
       transport_(std::move(transport_socket)),
       next_state_(STATE_NONE),
-      completed_handshake_(false),
+      phase_(PHASE_GREET),
       bytes_sent_(0),
+      error_after_write_(OK),
+      read_event_(NetLogEventType::SOCKS5_GREET_READ),
+      read_event_open_(false),
+      completed_handshake_(false),
       was_ever_used_(false),
       user_(user),
       pass_(pass),
@@ -80,8 +88,11 @@ int Socks5ServerSocket::Connect(CompletionOnceCallback callback) {
 
   net_log_.BeginEvent(NetLogEventType::SOCKS5_CONNECT);
 
-  next_state_ = STATE_GREET_READ;
+  next_state_ = STATE_READ;
+  phase_ = PHASE_GREET;
   buffer_.clear();
+  write_buffer_.clear();
+  error_after_write_ = OK;
 
   int rv = DoLoop(OK);
   if (rv == ERR_IO_PENDING) {
@@ -107,7 +118,8 @@ bool Socks5ServerSocket::IsConnected() const {
 }
 
 bool Socks5ServerSocket::IsConnectedAndIdle() const {
-  return completed_handshake_ && transport_->IsConnectedAndIdle();
+  return completed_handshake_ && buffer_.empty() &&
+         transport_->IsConnectedAndIdle();
 }
 
 const NetLogWithSource& Socks5ServerSocket::NetLog() const {
@@ -164,7 +176,32 @@ int Socks5ServerSocket::Read(IOBuffer* buf,
   DCHECK(!user_callback_);
   DCHECK(callback);
 
-  int rv = transport_->Read(
+  int rv = ReadEarlyData(buf, buf_len);
+  if (rv > 0)
+    return rv;
+
+  rv = transport_->Read(
+      buf, buf_len,
+      base::BindOnce(&Socks5ServerSocket::OnReadWriteComplete,
+                     base::Unretained(this), std::move(callback)));
+  if (rv > 0)
+    was_ever_used_ = true;
+  return rv;
+}
+
+int Socks5ServerSocket::ReadIfReady(IOBuffer* buf,
+                                    int buf_len,
+                                    CompletionOnceCallback callback) {
+  DCHECK(completed_handshake_);
+  DCHECK_EQ(STATE_NONE, next_state_);
+  DCHECK(!user_callback_);
+  DCHECK(callback);
+
+  int rv = ReadEarlyData(buf, buf_len);
+  if (rv > 0)
+    return rv;
+
+  rv = transport_->ReadIfReady(
       buf, buf_len,
       base::BindOnce(&Socks5ServerSocket::OnReadWriteComplete,
                      base::Unretained(this), std::move(callback)));
@@ -173,6 +210,10 @@ int Socks5ServerSocket::Read(IOBuffer* buf,
   return rv;
 }
 
+int Socks5ServerSocket::CancelReadIfReady() {
+  return transport_->CancelReadIfReady();
+}
+
 // Write is called by the transport layer. This can only be done if the
 // SOCKS handshake is complete.
 int Socks5ServerSocket::Write(
@@ -231,6 +272,17 @@ void Socks5ServerSocket::OnReadWriteComplete(CompletionOnceCallback callback,
   std::move(callback).Run(result);
 }
 
+int Socks5ServerSocket::ReadEarlyData(IOBuffer* buf, int buf_len) {
+  if (buffer_.empty())
+    return 0;
+
+  was_ever_used_ = true;
+  int data_len = std::min<size_t>(buffer_.size(), buf_len);
+  std::memcpy(buf->data(), buffer_.data(), data_len);
+  buffer_.erase(0, data_len);
+  return data_len;
+}
+
 int Socks5ServerSocket::DoLoop(int last_io_result) {
   DCHECK_NE(next_state_, STATE_NONE);
   int rv = last_io_result;
@@ -238,59 +290,23 @@ int Socks5ServerSocket::DoLoop(int last_io_result) {
     State state = next_state_;
     next_state_ = STATE_NONE;
     switch (state) {
-      case STATE_GREET_READ:
-        DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_GREET_READ);
-        rv = DoGreetRead();
-        break;
-      case STATE_GREET_READ_COMPLETE:
-        rv = DoGreetReadComplete(rv);
-        net_log_.EndEventWithNetErrorCode(NetLogEventType::SOCKS5_GREET_READ,
-                                          rv);
-        break;
-      case STATE_GREET_WRITE:
-        DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_GREET_WRITE);
-        rv = DoGreetWrite();
-        break;
-      case STATE_GREET_WRITE_COMPLETE:
-        rv = DoGreetWriteComplete(rv);
-        net_log_.EndEventWithNetErrorCode(NetLogEventType::SOCKS5_GREET_WRITE,
-                                          rv);
-        break;
-      case STATE_AUTH_READ:
+      case STATE_READ:
         DCHECK_EQ(OK, rv);
-        rv = DoAuthRead();
+        rv = DoRead();
         break;
-      case STATE_AUTH_READ_COMPLETE:
-        rv = DoAuthReadComplete(rv);
+      case STATE_READ_COMPLETE:
+        rv = DoReadComplete(rv);
         break;
-      case STATE_AUTH_WRITE:
+      case STATE_PARSE:
         DCHECK_EQ(OK, rv);
-        rv = DoAuthWrite();
-        break;
-      case STATE_AUTH_WRITE_COMPLETE:
-        rv = DoAuthWriteComplete(rv);
+        rv = DoParse();
         break;
-      case STATE_HANDSHAKE_READ:
+      case STATE_WRITE:
         DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_HANDSHAKE_READ);
-        rv = DoHandshakeRead();
+        rv = DoWrite();
         break;
-      case STATE_HANDSHAKE_READ_COMPLETE:
-        rv = DoHandshakeReadComplete(rv);
-        net_log_.EndEventWithNetErrorCode(
-            NetLogEventType::SOCKS5_HANDSHAKE_READ, rv);
-        break;
-      case STATE_HANDSHAKE_WRITE:
-        DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_HANDSHAKE_WRITE);
-        rv = DoHandshakeWrite();
-        break;
-      case STATE_HANDSHAKE_WRITE_COMPLETE:
-        rv = DoHandshakeWriteComplete(rv);
-        net_log_.EndEventWithNetErrorCode(
-            NetLogEventType::SOCKS5_HANDSHAKE_WRITE, rv);
+      case STATE_WRITE_COMPLETE:
+        rv = DoWriteComplete(rv);
         break;
       default:
         NOTREACHED() << "bad state";
@@ -301,365 +317,354 @@ int Socks5ServerSocket::DoLoop(int last_io_result) {
   return rv;
 }
 
-int Socks5ServerSocket::DoGreetRead() {
-  next_state_ = STATE_GREET_READ_COMPLETE;
-
-  if (buffer_.empty()) {
-    read_header_size_ = kGreetReadHeaderSize;
-  }
+int Socks5ServerSocket::DoRead() {
+  next_state_ = STATE_READ_COMPLETE;
+  BeginReadEvent(phase_);
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  if (!handshake_buf_)
+    handshake_buf_ = base::MakeRefCounted<IOBuffer>(kReadBufferSize);
+  return transport_->Read(handshake_buf_.get(), kReadBufferSize, io_callback_);
 }
 
-int Socks5ServerSocket::DoGreetReadComplete(int result) {
-  if (result < 0)
+int Socks5ServerSocket::DoReadComplete(int result) {
+  if (result < 0) {
+    EndReadEvent(result);
     return result;
+  }
 
   if (result == 0) {
-    net_log_.AddEvent(
-        NetLogEventType::SOCKS_UNEXPECTEDLY_CLOSED_DURING_GREETING);
+    if (phase_ == PHASE_GREET) {
+      net_log_.AddEvent(
+          NetLogEventType::SOCKS_UNEXPECTEDLY_CLOSED_DURING_GREETING);
+    } else {
+      net_log_.AddEvent(
+          NetLogEventType::SOCKS_UNEXPECTEDLY_CLOSED_DURING_HANDSHAKE);
+    }
+    EndReadEvent(ERR_SOCKS_CONNECTION_FAILED);
     return ERR_SOCKS_CONNECTION_FAILED;
   }
 
   buffer_.append(handshake_buf_->data(), result);
+  next_state_ = STATE_PARSE;
+  return OK;
+}
 
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kGreetReadHeaderSize) {
-    if (buffer_[0] != kSOCKS5Version) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
-      return ERR_SOCKS_CONNECTION_FAILED;
+// Parses as many phases as are available in |buffer_|, so a pipelined
+// handshake takes one read and one write.
+int Socks5ServerSocket::DoParse() {
+  int rv = OK;
+  while (phase_ != PHASE_DONE && error_after_write_ == OK) {
+    Phase phase = phase_;
+    // Read and write events must nest, so while replies are queued the read
+    // event of a pipelined phase is only logged once the phase is complete.
+    bool replies_queued = !write_events_.empty();
+    if (!replies_queued)
+      BeginReadEvent(phase);
+    if (phase == PHASE_GREET) {
+      rv = ParseGreet();
+    } else if (phase == PHASE_AUTH) {
+      rv = ParseAuth();
+    } else {
+      rv = ParseHandshake();
     }
-    int nmethods = buffer_[1];
-    if (nmethods == 0) {
-      net_log_.AddEvent(NetLogEventType::SOCKS_NO_REQUESTED_AUTH);
-      return ERR_SOCKS_CONNECTION_FAILED;
+    if (rv == ERR_IO_PENDING)
+      break;
+    if (replies_queued)
+      BeginReadEvent(phase);
+    EndReadEvent(rv);
+    if (rv != OK) {
+      EndWriteEvents(rv);
+      return rv;
     }
-
-    read_header_size_ += nmethods;
-    next_state_ = STATE_GREET_READ;
-    return OK;
+    write_events_.push_back(WriteEventForPhase(phase));
+    net_log_.BeginEvent(write_events_.back());
   }
 
-  if (buffer_.size() == read_header_size_) {
-    int nmethods = buffer_[1];
-    char expected_method = kAuthMethodNone;
-    if (!user_.empty() || !pass_.empty()) {
-      expected_method = kAuthMethodUserPass;
-    }
-    void* match =
-        std::memchr(&buffer_[kGreetReadHeaderSize], expected_method, nmethods);
-    if (match) {
-      auth_method_ = expected_method;
-    } else {
-      auth_method_ = kAuthMethodNoAcceptable;
-    }
-    buffer_.clear();
-    next_state_ = STATE_GREET_WRITE;
-    return OK;
+  if (!write_buffer_.empty()) {
+    // Replies must be written before waiting for more data, because the
+    // client may wait for them.
+    next_state_ = STATE_WRITE;
+  } else {
+    DCHECK_EQ(rv, ERR_IO_PENDING);
+    next_state_ = STATE_READ;
   }
-
-  next_state_ = STATE_GREET_READ;
   return OK;
 }
 
-int Socks5ServerSocket::DoGreetWrite() {
-  if (buffer_.empty()) {
-    const char write_data[] = {kSOCKS5Version, auth_method_};
-    buffer_ = std::string(write_data, base::size(write_data));
-    bytes_sent_ = 0;
-  }
+int Socks5ServerSocket::ParseGreet() {
+  if (buffer_.size() < kGreetReadHeaderSize)
+    return ERR_IO_PENDING;
 
-  next_state_ = STATE_GREET_WRITE_COMPLETE;
-  int handshake_buf_len = buffer_.size() - bytes_sent_;
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  std::memcpy(handshake_buf_->data(), &buffer_.data()[bytes_sent_],
-              handshake_buf_len);
-  return transport_->Write(handshake_buf_.get(), handshake_buf_len,
-                           io_callback_, traffic_annotation_);
-}
+  if (buffer_[0] != kSOCKS5Version) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", buffer_[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
+  }
+  int nmethods = static_cast<uint8_t>(buffer_[1]);
+  if (nmethods == 0) {
+    net_log_.AddEvent(NetLogEventType::SOCKS_NO_REQUESTED_AUTH);
+    return ERR_SOCKS_CONNECTION_FAILED;
+  }
 
-int Socks5ServerSocket::DoGreetWriteComplete(int result) {
-  if (result < 0)
-    return result;
+  size_t greet_size = kGreetReadHeaderSize + nmethods;
+  if (buffer_.size() < greet_size)
+    return ERR_IO_PENDING;
 
-  bytes_sent_ += result;
-  if (bytes_sent_ == buffer_.size()) {
-    buffer_.clear();
-    if (auth_method_ == kAuthMethodNone) {
-      next_state_ = STATE_HANDSHAKE_READ;
-    } else if (auth_method_ == kAuthMethodUserPass) {
-      next_state_ = STATE_AUTH_READ;
-    } else {
-      net_log_.AddEvent(NetLogEventType::SOCKS_NO_ACCEPTABLE_AUTH);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+  char expected_method = kAuthMethodNone;
+  if (!user_.empty() || !pass_.empty()) {
+    expected_method = kAuthMethodUserPass;
+  }
+  void* match =
+      std::memchr(&buffer_[kGreetReadHeaderSize], expected_method, nmethods);
+  char auth_method = match ? expected_method : kAuthMethodNoAcceptable;
+  buffer_.erase(0, greet_size);
+
+  const char write_data[] = {kSOCKS5Version, auth_method};
+  write_buffer_.append(write_data, base::size(write_data));
+
+  if (auth_method == kAuthMethodNone) {
+    phase_ = PHASE_HANDSHAKE;
+  } else if (auth_method == kAuthMethodUserPass) {
+    phase_ = PHASE_AUTH;
   } else {
-    next_state_ = STATE_GREET_WRITE;
+    net_log_.AddEvent(NetLogEventType::SOCKS_NO_ACCEPTABLE_AUTH);
+    error_after_write_ = ERR_SOCKS_CONNECTION_FAILED;
   }
   return OK;
 }
 
-int Socks5ServerSocket::DoAuthRead() {
-  next_state_ = STATE_AUTH_READ_COMPLETE;
+int Socks5ServerSocket::ParseAuth() {
+  if (buffer_.size() < kAuthReadHeaderSize)
+    return ERR_IO_PENDING;
 
-  if (buffer_.empty()) {
-    read_header_size_ = kAuthReadHeaderSize;
+  if (buffer_[0] != kSubnegotiationVersion) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", buffer_[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
+  }
+  size_t username_len = static_cast<uint8_t>(buffer_[1]);
+  size_t password_offset = kAuthReadHeaderSize + username_len + 1;
+  if (buffer_.size() < password_offset)
+    return ERR_IO_PENDING;
+
+  size_t password_len = static_cast<uint8_t>(buffer_[password_offset - 1]);
+  size_t auth_size = password_offset + password_len;
+  if (buffer_.size() < auth_size)
+    return ERR_IO_PENDING;
+
+  char auth_status;
+  if (buffer_.compare(kAuthReadHeaderSize, username_len, user_) == 0 &&
+      buffer_.compare(password_offset, password_len, pass_) == 0) {
+    auth_status = kAuthStatusSuccess;
+  } else {
+    auth_status = kAuthStatusFailure;
   }
+  buffer_.erase(0, auth_size);
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  const char write_data[] = {kSubnegotiationVersion, auth_status};
+  write_buffer_.append(write_data, base::size(write_data));
+
+  if (auth_status == kAuthStatusSuccess) {
+    phase_ = PHASE_HANDSHAKE;
+  } else {
+    error_after_write_ = ERR_SOCKS_CONNECTION_FAILED;
+  }
+  return OK;
 }
 
-int Socks5ServerSocket::DoAuthReadComplete(int result) {
-  if (result < 0)
-    return result;
+int Socks5ServerSocket::ParseHandshake() {
+  if (buffer_.size() < kReadHeaderSize)
+    return ERR_IO_PENDING;
 
-  if (result == 0) {
+  if (buffer_[0] != kSOCKS5Version || buffer_[2] != kSOCKS5Reserved) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", buffer_[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
+  }
+  char reply;
+  SocksCommandType command = static_cast<SocksCommandType>(buffer_[1]);
+  if (command == kCommandConnect) {
+    // The proxy replies with success immediately without first connecting
+    // to the requested endpoint.
+    reply = kReplySuccess;
+  } else if (command == kCommandBind || command == kCommandUDPAssociate) {
+    reply = kReplyCommandNotSupported;
+  } else {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_COMMAND,
+                                   "commmand", buffer_[1]);
     return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
-
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kAuthReadHeaderSize) {
-    if (buffer_[0] != kSubnegotiationVersion) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
+  // We check the type of IP/Domain the client requests and accordingly
+  // compute the size of the request. For domains, the size of the domain is
+  // the last byte of the header. For IPv4/IPv6 the size is fixed and the
+  // last byte of the header is already part of the address.
+  size_t address_start;
+  size_t address_size;
+  SocksEndPointAddressType address_type =
+      static_cast<SocksEndPointAddressType>(buffer_[3]);
+  if (address_type == kEndPointDomain) {
+    address_start = kReadHeaderSize;
+    address_size = static_cast<uint8_t>(buffer_[4]);
+    if (address_size == 0) {
+      net_log_.AddEvent(NetLogEventType::SOCKS_ZERO_LENGTH_DOMAIN);
       return ERR_SOCKS_CONNECTION_FAILED;
     }
-    int username_len = buffer_[1];
-    read_header_size_ += username_len + 1;
-    next_state_ = STATE_AUTH_READ;
-    return OK;
+  } else if (address_type == kEndPointResolvedIPv4) {
+    address_start = kReadHeaderSize - 1;
+    address_size = sizeof(struct in_addr);
+  } else if (address_type == kEndPointResolvedIPv6) {
+    address_start = kReadHeaderSize - 1;
+    address_size = sizeof(struct in6_addr);
+  } else {
+    // Aborts connection on unspecified address type.
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNKNOWN_ADDRESS_TYPE,
+                                   "address_type", buffer_[3]);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  if (buffer_.size() == read_header_size_) {
-    int username_len = buffer_[1];
-    int password_len = buffer_[kAuthReadHeaderSize + username_len];
-    size_t password_offset = kAuthReadHeaderSize + username_len + 1;
-    if (buffer_.size() == password_offset && password_len != 0) {
-      read_header_size_ += password_len;
-      next_state_ = STATE_AUTH_READ;
-      return OK;
-    }
+  size_t port_start = address_start + address_size;
+  size_t request_size = port_start + sizeof(uint16_t);
+  if (buffer_.size() < request_size)
+    return ERR_IO_PENDING;
 
-    if (buffer_.compare(kAuthReadHeaderSize, username_len, user_) == 0 &&
-        buffer_.compare(password_offset, password_len, pass_) == 0) {
-      auth_status_ = kAuthStatusSuccess;
-    } else {
-      auth_status_ = kAuthStatusFailure;
-    }
-    buffer_.clear();
-    next_state_ = STATE_AUTH_WRITE;
-    return OK;
-  }
-
-  next_state_ = STATE_AUTH_READ;
-  return OK;
-}
+  uint16_t port_net;
+  std::memcpy(&port_net, &buffer_[port_start], sizeof(uint16_t));
+  uint16_t port_host = base::NetToHost16(port_net);
 
-int Socks5ServerSocket::DoAuthWrite() {
-  if (buffer_.empty()) {
-    const char write_data[] = {kSubnegotiationVersion, auth_status_};
-    buffer_ = std::string(write_data, base::size(write_data));
-    bytes_sent_ = 0;
+  if (address_type == kEndPointDomain) {
+    std::string domain(&buffer_[address_start], address_size);
+    request_endpoint_ = HostPortPair(domain, port_host);
+  } else {
+    IPAddress ip_addr(reinterpret_cast<const uint8_t*>(&buffer_[address_start]),
+                      address_size);
+    IPEndPoint endpoint(ip_addr, port_host);
+    request_endpoint_ = HostPortPair::FromIPEndPoint(endpoint);
   }
-
-  next_state_ = STATE_AUTH_WRITE_COMPLETE;
-  int handshake_buf_len = buffer_.size() - bytes_sent_;
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  std::memcpy(handshake_buf_->data(), &buffer_.data()[bytes_sent_],
-              handshake_buf_len);
-  return transport_->Write(handshake_buf_.get(), handshake_buf_len,
-                           io_callback_, traffic_annotation_);
-}
-
-int Socks5ServerSocket::DoAuthWriteComplete(int result) {
-  if (result < 0)
-    return result;
-
-  bytes_sent_ += result;
-  if (bytes_sent_ == buffer_.size()) {
-    buffer_.clear();
-    if (auth_status_ == kAuthStatusSuccess) {
-      next_state_ = STATE_HANDSHAKE_READ;
-    } else {
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+  // Anything left in |buffer_| is early application data.
+  buffer_.erase(0, request_size);
+
+  const char write_data[] = {
+      // clang-format off
+      kSOCKS5Version,
+      reply,
+      kSOCKS5Reserved,
+      kEndPointResolvedIPv4,
+      0x00, 0x00, 0x00, 0x00,  // BND.ADDR
+      0x00, 0x00,  // BND.PORT
+      // clang-format on
+  };
+  write_buffer_.append(write_data, base::size(write_data));
+
+  if (reply == kReplySuccess) {
+    phase_ = PHASE_DONE;
   } else {
-    next_state_ = STATE_AUTH_WRITE;
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_SERVER_ERROR,
+                                   "error_code", reply);
+    error_after_write_ = ERR_SOCKS_CONNECTION_FAILED;
   }
   return OK;
 }
 
-int Socks5ServerSocket::DoHandshakeRead() {
-  next_state_ = STATE_HANDSHAKE_READ_COMPLETE;
-
-  if (buffer_.empty()) {
-    read_header_size_ = kReadHeaderSize;
-  }
+// Writes the replies queued so far to the underlying socket connection.
+int Socks5ServerSocket::DoWrite() {
+  next_state_ = STATE_WRITE_COMPLETE;
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
+  int handshake_buf_len = write_buffer_.size() - bytes_sent_;
   DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  auto write_buf = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
+  std::memcpy(write_buf->data(), &write_buffer_[bytes_sent_],
+              handshake_buf_len);
+  return transport_->Write(write_buf.get(), handshake_buf_len, io_callback_,
+                           traffic_annotation_);
 }
 
-int Socks5ServerSocket::DoHandshakeReadComplete(int result) {
-  if (result < 0)
+int Socks5ServerSocket::DoWriteComplete(int result) {
+  if (result < 0) {
+    EndReadEvent(result);
+    EndWriteEvents(result);
     return result;
-
-  // The underlying socket closed unexpectedly.
-  if (result == 0) {
-    net_log_.AddEvent(
-        NetLogEventType::SOCKS_UNEXPECTEDLY_CLOSED_DURING_HANDSHAKE);
-    return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
-
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kReadHeaderSize) {
-    if (buffer_[0] != kSOCKS5Version || buffer_[2] != kSOCKS5Reserved) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-    SocksCommandType command = static_cast<SocksCommandType>(buffer_[1]);
-    if (command == kCommandConnect) {
-      // The proxy replies with success immediately without first connecting
-      // to the requested endpoint.
-      reply_ = kReplySuccess;
-    } else if (command == kCommandBind || command == kCommandUDPAssociate) {
-      reply_ = kReplyCommandNotSupported;
-    } else {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_COMMAND,
-                                     "commmand", buffer_[1]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-
-    // We check the type of IP/Domain the server returns and accordingly
-    // increase the size of the request. For domains, we need to read the
-    // size of the domain, so the initial request size is upto the domain
-    // size. Since for IPv4/IPv6 the size is fixed and hence no 'size' is
-    // read, we substract 1 byte from the additional request size.
-    address_type_ = static_cast<SocksEndPointAddressType>(buffer_[3]);
-    if (address_type_ == kEndPointDomain) {
-      address_size_ = static_cast<uint8_t>(buffer_[4]);
-      if (address_size_ == 0) {
-        net_log_.AddEvent(NetLogEventType::SOCKS_ZERO_LENGTH_DOMAIN);
-        return ERR_SOCKS_CONNECTION_FAILED;
-      }
-    } else if (address_type_ == kEndPointResolvedIPv4) {
-      address_size_ = sizeof(struct in_addr);
-      --read_header_size_;
-    } else if (address_type_ == kEndPointResolvedIPv6) {
-      address_size_ = sizeof(struct in6_addr);
-      --read_header_size_;
-    } else {
-      // Aborts connection on unspecified address type.
-      net_log_.AddEventWithIntParams(
-          NetLogEventType::SOCKS_UNKNOWN_ADDRESS_TYPE, "address_type",
-          buffer_[3]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+  // We ignore the case when result is 0, since the underlying Write
+  // may return spurious writes while waiting on the socket.
 
-    read_header_size_ += address_size_ + sizeof(uint16_t);
-    next_state_ = STATE_HANDSHAKE_READ;
+  bytes_sent_ += result;
+  if (bytes_sent_ < write_buffer_.size()) {
+    next_state_ = STATE_WRITE;
     return OK;
   }
 
-  // When the final bytes are read, setup handshake.
-  if (buffer_.size() == read_header_size_) {
-    size_t port_start = read_header_size_ - sizeof(uint16_t);
-    uint16_t port_net;
-    std::memcpy(&port_net, &buffer_[port_start], sizeof(uint16_t));
-    uint16_t port_host = base::NetToHost16(port_net);
-
-    size_t address_start = port_start - address_size_;
-    if (address_type_ == kEndPointDomain) {
-      std::string domain(&buffer_[address_start], address_size_);
-      request_endpoint_ = HostPortPair(domain, port_host);
-    } else {
-      IPAddress ip_addr(
-          reinterpret_cast<const uint8_t*>(&buffer_[address_start]),
-          address_size_);
-      IPEndPoint endpoint(ip_addr, port_host);
-      request_endpoint_ = HostPortPair::FromIPEndPoint(endpoint);
-    }
-    buffer_.clear();
-    next_state_ = STATE_HANDSHAKE_WRITE;
+  write_buffer_.clear();
+  bytes_sent_ = 0;
+  EndWriteEvents(OK);
+  if (error_after_write_ != OK)
+    return error_after_write_;
+
+  if (phase_ == PHASE_DONE) {
+    handshake_buf_ = nullptr;
+    completed_handshake_ = true;
+    next_state_ = STATE_NONE;
     return OK;
   }
 
-  next_state_ = STATE_HANDSHAKE_READ;
+  // Everything received has been parsed, or the parser would have continued.
+  next_state_ = STATE_READ;
   return OK;
 }
 
-// Writes the SOCKS handshake data to the underlying socket connection.
-int Socks5ServerSocket::DoHandshakeWrite() {
-  next_state_ = STATE_HANDSHAKE_WRITE_COMPLETE;
-
-  if (buffer_.empty()) {
-    const char write_data[] = {
-        // clang-format off
-        kSOCKS5Version,
-        reply_,
-        kSOCKS5Reserved,
-        kEndPointResolvedIPv4,
-        0x00, 0x00, 0x00, 0x00,  // BND.ADDR
-        0x00, 0x00,  // BND.PORT
-        // clang-format on
-    };
-    buffer_ = std::string(write_data, base::size(write_data));
-    bytes_sent_ = 0;
+// static
+NetLogEventType Socks5ServerSocket::ReadEventForPhase(Phase phase) {
+  switch (phase) {
+    case PHASE_GREET:
+      return NetLogEventType::SOCKS5_GREET_READ;
+    case PHASE_AUTH:
+      return NetLogEventType::SOCKS5_AUTH_READ;
+    case PHASE_HANDSHAKE:
+      return NetLogEventType::SOCKS5_HANDSHAKE_READ;
+    case PHASE_DONE:
+      break;
   }
-
-  int handshake_buf_len = buffer_.size() - bytes_sent_;
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  std::memcpy(handshake_buf_->data(), &buffer_[bytes_sent_], handshake_buf_len);
-  return transport_->Write(handshake_buf_.get(), handshake_buf_len,
-                           io_callback_, traffic_annotation_);
+  NOTREACHED();
+  return NetLogEventType::SOCKS5_HANDSHAKE_READ;
+}
+
+// static
+NetLogEventType Socks5ServerSocket::WriteEventForPhase(Phase phase) {
+  switch (phase) {
+    case PHASE_GREET:
+      return NetLogEventType::SOCKS5_GREET_WRITE;
+    case PHASE_AUTH:
+      return NetLogEventType::SOCKS5_AUTH_WRITE;
+    case PHASE_HANDSHAKE:
+      return NetLogEventType::SOCKS5_HANDSHAKE_WRITE;
+    case PHASE_DONE:
+      break;
+  }
+  NOTREACHED();
+  return NetLogEventType::SOCKS5_HANDSHAKE_WRITE;
 }
 
-int Socks5ServerSocket::DoHandshakeWriteComplete(int result) {
-  if (result < 0)
-    return result;
-
-  // We ignore the case when result is 0, since the underlying Write
-  // may return spurious writes while waiting on the socket.
+void Socks5ServerSocket::BeginReadEvent(Phase phase) {
+  if (read_event_open_)
+    return;
+  read_event_ = ReadEventForPhase(phase);
+  read_event_open_ = true;
+  net_log_.BeginEvent(read_event_);
+}
 
-  bytes_sent_ += result;
-  if (bytes_sent_ == buffer_.size()) {
-    buffer_.clear();
-    if (reply_ == kReplySuccess) {
-      completed_handshake_ = true;
-      next_state_ = STATE_NONE;
-    } else {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_SERVER_ERROR,
-                                     "error_code", reply_);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-  } else {
-    next_state_ = STATE_HANDSHAKE_WRITE;
-  }
+void Socks5ServerSocket::EndReadEvent(int result) {
+  if (!read_event_open_)
+    return;
+  read_event_open_ = false;
+  net_log_.EndEventWithNetErrorCode(read_event_, result);
+}
 
-  return OK;
+void Socks5ServerSocket::EndWriteEvents(int result) {
+  // Ends the replies of later phases first, so that the events nest.
+  for (auto it = write_events_.rbegin(); it != write_events_.rend(); ++it)
+    net_log_.EndEventWithNetErrorCode(*it, result);
+  write_events_.clear();
 }
 
 int Socks5ServerSocket::GetPeerAddress(IPEndPoint* address) const {
@@ -10,6 +10,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/macros.h"
 #include "base/memory/scoped_refptr.h"
@@ -18,6 +19,7 @@
 #include "net/base/host_port_pair.h"
 #include "net/base/io_buffer.h"
 #include "net/base/ip_endpoint.h"
+#include "net/log/net_log_event_type.h"
 #include "net/log/net_log_with_source.h"
 #include "net/socket/connection_attempts.h"
 #include "net/socket/next_proto.h"
@@ -63,6 +65,10 @@ class Socks5ServerSocket : public StreamSocket {
   int Read(IOBuffer* buf,
            int buf_len,
            CompletionOnceCallback callback) override;
+  int ReadIfReady(IOBuffer* buf,
+                  int buf_len,
+                  CompletionOnceCallback callback) override;
+  int CancelReadIfReady() override;
   int Write(IOBuffer* buf,
             int buf_len,
             CompletionOnceCallback callback,
@@ -76,21 +82,22 @@ class Socks5ServerSocket : public StreamSocket {
 
  private:
   enum State {
-    STATE_GREET_READ,
-    STATE_GREET_READ_COMPLETE,
-    STATE_GREET_WRITE,
-    STATE_GREET_WRITE_COMPLETE,
-    STATE_AUTH_READ,
-    STATE_AUTH_READ_COMPLETE,
-    STATE_AUTH_WRITE,
-    STATE_AUTH_WRITE_COMPLETE,
-    STATE_HANDSHAKE_WRITE,
-    STATE_HANDSHAKE_WRITE_COMPLETE,
-    STATE_HANDSHAKE_READ,
-    STATE_HANDSHAKE_READ_COMPLETE,
+    STATE_READ,
+    STATE_READ_COMPLETE,
+    STATE_PARSE,
+    STATE_WRITE,
+    STATE_WRITE_COMPLETE,
     STATE_NONE,
   };
 
+  // The handshake phase the parser is waiting for.
+  enum Phase {
+    PHASE_GREET,
+    PHASE_AUTH,
+    PHASE_HANDSHAKE,
+    PHASE_DONE,
+  };
+
   // Addressing type that can be specified in requests or responses.
   enum SocksEndPointAddressType {
     kEndPointDomain = 0x03,
@@ -102,19 +109,30 @@ class Socks5ServerSocket : public StreamSocket {
   void OnIOComplete(int result);
   void OnReadWriteComplete(CompletionOnceCallback callback, int result);
 
+  // Copies early data pipelined with the handshake into |buf|. Returns 0 if
+  // there is none left.
+  int ReadEarlyData(IOBuffer* buf, int buf_len);
+
   int DoLoop(int last_io_result);
-  int DoGreetRead();
-  int DoGreetReadComplete(int result);
-  int DoGreetWrite();
-  int DoGreetWriteComplete(int result);
-  int DoAuthRead();
-  int DoAuthReadComplete(int result);
-  int DoAuthWrite();
-  int DoAuthWriteComplete(int result);
-  int DoHandshakeRead();
-  int DoHandshakeReadComplete(int result);
-  int DoHandshakeWrite();
-  int DoHandshakeWriteComplete(int result);
+  int DoRead();
+  int DoReadComplete(int result);
+  int DoParse();
+  int DoWrite();
+  int DoWriteComplete(int result);
+
+  // Each parses one phase from the front of |buffer_|. Returns ERR_IO_PENDING
+  // if more data is needed, OK if the phase is consumed and its reply is
+  // queued in |write_buffer_|, or an error.
+  int ParseGreet();
+  int ParseAuth();
+  int ParseHandshake();
+
+  // NetLog events spanning the read and the reply write of each phase.
+  static NetLogEventType ReadEventForPhase(Phase phase);
+  static NetLogEventType WriteEventForPhase(Phase phase);
+  void BeginReadEvent(Phase phase);
+  void EndReadEvent(int result);
+  void EndWriteEvents(int result);
 
   CompletionRepeatingCallback io_callback_;
 
@@ -122,38 +140,47 @@ class Socks5ServerSocket : public StreamSocket {
   std::unique_ptr<StreamSocket> transport_;
 
   State next_state_;
+  Phase phase_;
 
   // Stores the callback to the layer above, called on completing Connect().
   CompletionOnceCallback user_callback_;
 
-  // This IOBuffer is used by the class to read and write
-  // SOCKS handshake data. The length contains the expected size to
-  // read or write.
+  // This IOBuffer is used by the class to read and write SOCKS handshake
+  // data.
   scoped_refptr<IOBuffer> handshake_buf_;
 
-  // While writing, this buffer stores the complete write handshake data.
-  // While reading, it stores the handshake information received so far.
+  // Stores the data received but not yet parsed. Clients may pipeline the
+  // greeting, authentication and request in one segment, followed by early
+  // application data. The application data left after the handshake is
+  // returned by the first Read().
   std::string buffer_;
 
-  // This becomes true when the SOCKS handshake has completed and the
-  // overlying connection is free to communicate.
-  bool completed_handshake_;
+  // Stores the replies of all phases parsed so far, which are written in one
+  // batch.
+  std::string write_buffer_;
 
-  // Contains the bytes sent by the SOCKS handshake.
+  // Contains the bytes of |write_buffer_| sent so far.
   size_t bytes_sent_;
 
-  size_t read_header_size_;
+  // The error to return after the queued reply has been written, e.g. when
+  // the client has to be told about an authentication failure.
+  int error_after_write_;
 
-  bool was_ever_used_;
+  // The read event of the phase being parsed, if it has begun.
+  NetLogEventType read_event_;
+  bool read_event_open_;
 
-  SocksEndPointAddressType address_type_;
-  int address_size_;
+  // The write events of the replies in |write_buffer_|.
+  std::vector<NetLogEventType> write_events_;
+
+  // This becomes true when the SOCKS handshake has completed and the
+  // overlying connection is free to communicate.
+  bool completed_handshake_;
+
+  bool was_ever_used_;
 
   std::string user_;
   std::string pass_;
-  char auth_method_;
-  char auth_status_;
-  char reply_;
 
   HostPortPair request_endpoint_;
 
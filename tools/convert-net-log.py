@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# Converts a NetLog saved with --log-net-log-binary to the JSON format read by
+# https://netlog-viewer.appspot.com/.
+#
+# Usage: convert-net-log.py <input> [<output.json>]
+
+import json
+import struct
+import sys
+
+MAGIC = b'NAIVENL1'
+
+# Binary values are omitted from JSON NetLogs.
+OMITTED = object()
+
+
+class Reader:
+  def __init__(self, data):
+    self.data = data
+    self.pos = 0
+
+  def at_end(self):
+    return self.pos >= len(self.data)
+
+  def byte(self):
+    b = self.data[self.pos]
+    self.pos += 1
+    return b
+
+  def bytes(self, n):
+    if self.pos + n > len(self.data):
+      raise EOFError()
+    b = self.data[self.pos:self.pos + n]
+    self.pos += n
+    return b
+
+  def varint(self):
+    result = 0
+    shift = 0
+    while True:
+      b = self.byte()
+      result |= (b & 0x7f) << shift
+      if b < 0x80:
+        return result
+      shift += 7
+
+  def signed_varint(self):
+    v = self.varint()
+    return (v >> 1) ^ -(v & 1)
+
+  def string(self):
+    return self.bytes(self.varint()).decode('utf-8', 'replace')
+
+  def value(self):
+    tag = self.byte()
+    if tag == 0:
+      return None
+    if tag == 1:
+      return False
+    if tag == 2:
+      return True
+    if tag == 3:
+      return self.signed_varint()
+    if tag == 4:
+      d = struct.unpack('<d', self.bytes(8))[0]
+      return int(d) if d.is_integer() else d
+    if tag == 5:
+      return self.string()
+    if tag == 6:
+      self.bytes(self.varint())
+      return OMITTED
+    if tag == 7:
+      result = {}
+      for _ in range(self.varint()):
+        key = self.string()
+        value = self.value()
+        if value is not OMITTED:
+          result[key] = value
+      return result
+    if tag == 8:
+      values = [self.value() for _ in range(self.varint())]
+      return [v for v in values if v is not OMITTED]
+    raise ValueError('unknown value tag %d at offset %d' % (tag, self.pos - 1))
+
+
+def tick_count_to_string(us):
+  # Matches NetLog::TickCountToString(), which truncates to milliseconds.
+  return str(int(us / 1000))
+
+
+def convert(data, out):
+  if data[:len(MAGIC)] != MAGIC:
+    raise ValueError('not a binary NetLog')
+  reader = Reader(data)
+  reader.pos = len(MAGIC)
+  constants = reader.string()
+
+  out.write('{"constants":')
+  out.write(constants if constants else '{}')
+  out.write(',\n"events": [\n')
+
+  time = 0
+  first = True
+  while not reader.at_end():
+    try:
+      time += reader.signed_varint()
+      event_type = reader.varint()
+      phase = reader.varint()
+      source_type = reader.varint()
+      source_id = reader.varint()
+      source_start = time + reader.signed_varint()
+      params = reader.value()
+    except (EOFError, IndexError):
+      # The process was killed while writing the last chunk.
+      break
+
+    event = {
+        'time': tick_count_to_string(time),
+        'source': {
+            'id': source_id,
+            'type': source_type,
+            'start_time': tick_count_to_string(source_start),
+        },
+        'type': event_type,
+        'phase': phase,
+    }
+    if params is not None and params is not OMITTED:
+      event['params'] = params
+    if not first:
+      out.write(',\n')
+    first = False
+    json.dump(event, out, separators=(',', ':'))
+
+  out.write(']}\n')
+
+
+def main():
+  if len(sys.argv) not in (2, 3):
+    sys.stderr.write('Usage: %s <input> [<output.json>]\n' % sys.argv[0])
+    return 1
+  with open(sys.argv[1], 'rb') as f:
+    data = f.read()
+  if len(sys.argv) == 3:
+    with open(sys.argv[2], 'w') as out:
+      convert(data, out)
+  else:
+    convert(data, sys.stdout)
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())